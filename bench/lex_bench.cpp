@@ -0,0 +1,92 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#include "token.h"
+
+// Tokenizer throughput, best of a few runs over each file. Without files two
+// generated programs are measured, one of short dense tokens and one of
+// indented code with long names and comments. -jN lexes on N threads.
+
+#define RUNS 5
+
+static std::string dense(size_t statements)
+{
+    std::mt19937 rng(1);
+    std::string s = "main var a, b, c, d; {";
+    const char* vars[] = { "a", "b", "c", "d" };
+    for (size_t i = 0; i < statements; i++) {
+        s += i ? ";let " : "let ";
+        s += vars[rng() % 4];
+        s += "<-";
+        s += vars[rng() % 4];
+        s += "+";
+        s += std::to_string(rng() % 100);
+        s += "*";
+        s += vars[rng() % 4];
+    }
+    return s + "}.";
+}
+
+static std::string wide(size_t statements)
+{
+    std::mt19937 rng(2);
+    std::string s = "main\nvar accumulatedTotal, runningCounter, previousValue, temporaryResult;\n{\n";
+    const char* vars[] = { "accumulatedTotal", "runningCounter", "previousValue", "temporaryResult" };
+    for (size_t i = 0; i < statements; i++) {
+        s += i ? ";\n        let " : "        let ";
+        s += vars[rng() % 4];
+        s += " <- ";
+        s += vars[rng() % 4];
+        s += " + 1234567 * ";
+        s += vars[rng() % 4];
+        s += "    // keeps the running total of this iteration";
+    }
+    return s + "\n}.\n";
+}
+
+static void measure(const std::string& name, const std::function<TokenList()>& tokenize, size_t bytes)
+{
+    double best = 1e30;
+    size_t tokens = 0;
+    for (int i = 0; i < RUNS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        TokenList toks = tokenize();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        tokens = toks.size();
+    }
+    std::cout << name << ": " << bytes / 1e6 << " MB, " << tokens << " tokens, "
+              << bytes / best / 1e6 << " MB/s, " << tokens / best / 1e6 << " Mtokens/s\n";
+}
+
+int main(int argc, char** argv)
+{
+    unsigned jobs = 1;
+    int first = 1;
+    if (argc > 1 && std::string(argv[1]).rfind("-j", 0) == 0) {
+        jobs = std::max(1, std::atoi(argv[1] + 2));
+        first = 2;
+    }
+
+    if (argc > first) {
+        for (int i = first; i < argc; i++) {
+            std::filesystem::path file = argv[i];
+            measure(file.string(), [&]() {
+                TokenList toks;
+                if (!toks.tokenize(file, jobs))
+                    std::cerr << "failed to tokenize " << file << "\n";
+                return toks;
+            }, std::filesystem::file_size(file));
+        }
+        return 0;
+    }
+
+    for (auto& [name, source] : { std::make_pair("dense", dense(1 << 20)), std::make_pair("wide", wide(1 << 18)) }) {
+        measure(name, [&]() {
+            TokenList toks;
+            toks.tokenize_view(source, jobs);
+            return toks;
+        }, source.size());
+    }
+}
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <thread>
+
+#include "server.h"
+
+// Request latency against a compile server, or against a process per request
+// with --spawn. Every client sends its share of the requests one after the
+// other, cycling through the files, and asks for assembly.
+//
+//   ty_serve_bench [-c clients] [-n requests] (<socket> | --spawn <ty>) <file...>
+
+extern char** environ;
+
+static std::string read_file(const char* path)
+{
+    std::ifstream is(path);
+    std::stringstream ss;
+    ss << is.rdbuf();
+    return ss.str();
+}
+
+// one request, nothing if it failed
+static std::optional<double> spawn(const char* ty, const char* file)
+{
+    const char* argv[] = { ty, "-S", file, "-o", "/dev/null", nullptr };
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid;
+    if (posix_spawn(&pid, ty, nullptr, nullptr, (char**)argv, environ) != 0)
+        return std::nullopt;
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return std::nullopt;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    int clients = 1, requests = 1000;
+    const char* socket = nullptr;
+    const char* ty = nullptr;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            clients = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            requests = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--spawn") == 0 && i + 1 < argc)
+            ty = argv[++i];
+        else if (!socket && !ty)
+            socket = argv[i];
+        else
+            files.push_back(argv[i]);
+    }
+    if ((!socket && !ty) || files.empty()) {
+        std::cerr << "USAGE: ty_serve_bench [-c clients] [-n requests] (<socket> | --spawn <ty>) <file...>\n";
+        return 1;
+    }
+
+    std::vector<std::string> sources;
+    for (auto* file : files)
+        sources.push_back(read_file(file));
+
+    std::vector<std::vector<double>> latencies(clients);
+    std::atomic<int> failed = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&, c]() {
+            ServeClient client;
+            if (socket && !client.connect(socket)) {
+                failed += requests / clients;
+                return;
+            }
+            for (int i = c; i < requests; i += clients) {
+                size_t f = i % files.size();
+                if (ty) {
+                    auto seconds = spawn(ty, files[f]);
+                    if (seconds)
+                        latencies[c].push_back(*seconds);
+                    else
+                        failed++;
+                    continue;
+                }
+                auto begin = std::chrono::steady_clock::now();
+                auto response = client.compile(sources[f], ServeOutput::ASM);
+                if (response && response->first == ServeStatus::OK)
+                    latencies[c].push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+                else
+                    failed++;
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    for (auto& l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    const auto percentile = [&](double p) { return all.empty() ? 0 : all[std::min(all.size() - 1, (size_t)(p * all.size()))] * 1e3; };
+
+    std::cout << (ty ? "spawn" : "server") << ": " << all.size() << " requests, " << failed << " failed, "
+              << clients << " clients, " << all.size() / wall << " requests/s\n"
+              << "latency ms: p50 " << percentile(0.5) << ", p90 " << percentile(0.9) << ", p99 " << percentile(0.99)
+              << ", max " << percentile(1) << "\n";
+    return failed > 0;
+}
@@ -0,0 +1,94 @@
+#include "batch.h"
+#include "compiler.h"
+#include "pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+std::vector<std::filesystem::path> batch_inputs(const std::filesystem::path& dir_or_list)
+{
+    std::vector<std::filesystem::path> files;
+    if (std::filesystem::is_directory(dir_or_list)) {
+        for (auto& entry : std::filesystem::directory_iterator(dir_or_list))
+            if (entry.is_regular_file() && entry.path().extension() == ".ty")
+                files.push_back(entry.path());
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    std::ifstream list(dir_or_list);
+    for (std::string line; std::getline(list, line);)
+        if (!line.empty())
+            files.push_back(dir_or_list.parent_path() / line);
+    return files;
+}
+
+// empty on success, what went wrong otherwise
+static std::string compile(const std::filesystem::path& file, const std::filesystem::path& out, const BatchOptions& options)
+{
+    Compiler compiler({ 1, options.opt });
+    bool ok = compiler.compile_file(file);
+    if (ok) {
+        std::ofstream os(out);
+        if (!os)
+            return "failed to open " + out.string();
+        ok = options.assembly ? compiler.assembly(os) : compiler.dot(os);
+    }
+    if (ok)
+        return "";
+
+    auto& errors = compiler.errors();
+    std::string error = errors.front();
+    if (errors.size() > 1)
+        error += " (and " + std::to_string(errors.size() - 1) + " more)";
+    return error;
+}
+
+size_t compile_batch(const std::vector<std::filesystem::path>& files, const BatchOptions& options, std::ostream& report)
+{
+    struct Result {
+        std::filesystem::path out;
+        std::string error;
+        double seconds;
+    };
+    std::vector<Result> results(files.size());
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(options.jobs);
+        for (size_t i = 0; i < files.size(); i++) {
+            pool.submit([&, i]() {
+                auto& file = files[i];
+                auto& result = results[i];
+                result.out = options.out_dir.value_or(file.parent_path()) / file.stem();
+                result.out += options.assembly ? ".s" : ".dot";
+
+                auto begin = std::chrono::steady_clock::now();
+                result.error = compile(file, result.out, options);
+                result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            });
+        }
+        pool.wait();
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    double total = 0;
+    report << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < files.size(); i++) {
+        auto& [out, error, seconds] = results[i];
+        report << std::setw(10) << seconds * 1e3 << " ms  " << files[i].string();
+        if (error.empty())
+            report << " -> " << out.string() << "\n";
+        else
+            report << ": " << error << "\n";
+        failed += !error.empty();
+        total += seconds;
+    }
+    report << files.size() << " files, " << failed << " failed, " << total * 1e3 << " ms compiling, "
+           << wall * 1e3 << " ms on " << std::max(options.jobs, 1u) << " jobs, "
+           << (wall > 0 ? files.size() / wall : 0) << " files/s\n";
+    return failed;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <filesystem>
+#include <iosfwd>
+#include <optional>
+#include <vector>
+
+struct BatchOptions {
+    unsigned jobs = 1;
+    bool opt = true;
+    bool assembly = false; // x86-64 assembly instead of dot
+    // outputs are named after their input and go here, otherwise next to it
+    std::optional<std::filesystem::path> out_dir;
+};
+
+// the .ty files of a directory in name order, or the paths a file lists one
+// per line, relative to the list
+std::vector<std::filesystem::path> batch_inputs(const std::filesystem::path& dir_or_list);
+
+// Compiles every file into an output of its own on a work stealing pool, a
+// file that fails does not stop the others. The time and outcome of every
+// file go to the report in input order, followed by the totals. Returns the
+// number of files that failed.
+size_t compile_batch(const std::vector<std::filesystem::path>& files, const BatchOptions& options, std::ostream& report);
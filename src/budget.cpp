@@ -0,0 +1,34 @@
+#include "budget.h"
+
+Budget::Budget(size_t bytes, std::chrono::milliseconds time, std::pmr::memory_resource* upstream)
+    : upstream(upstream)
+    , bytes_limit(bytes)
+    , deadline(std::chrono::steady_clock::now() + time)
+{
+}
+
+void Budget::check() const
+{
+    if (std::chrono::steady_clock::now() > deadline)
+        throw BudgetExceeded(true);
+}
+
+void* Budget::do_allocate(size_t bytes, size_t align)
+{
+    std::lock_guard guard(lock);
+    if (bytes_used + (i64)bytes > bytes_limit)
+        throw BudgetExceeded(false);
+    check();
+
+    void* ptr = upstream->allocate(bytes, align);
+    bytes_used += bytes;
+    bytes_peak = std::max(bytes_peak, bytes_used);
+    return ptr;
+}
+
+void Budget::do_deallocate(void* ptr, size_t bytes, size_t align)
+{
+    upstream->deallocate(ptr, bytes, align);
+    std::lock_guard guard(lock);
+    bytes_used -= bytes;
+}
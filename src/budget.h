@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+
+// Limits the memory and time of a request, for compiling untrusted sources.
+// A budget is a memory resource, a compile given it takes the arenas of its ir
+// from it. The allocation that would go past the limit, or the first one
+// after the deadline, throws BudgetExceeded, which is a std::bad_alloc.
+// check() looks at the deadline between the stages of a request, work that
+// allocates nothing in between runs past it.
+struct BudgetExceeded : std::bad_alloc {
+    bool time;
+    explicit BudgetExceeded(bool time)
+        : time(time)
+    {
+    }
+    const char* what() const noexcept override { return time ? "time budget exceeded" : "memory budget exceeded"; }
+};
+
+class Budget : public std::pmr::memory_resource {
+public:
+    Budget(size_t bytes, std::chrono::milliseconds time, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    Budget(const Budget&) = delete;
+
+    // throws BudgetExceeded once the deadline has passed
+    void check() const;
+
+    // bytes taken from the budget and not given back yet
+    inline i64 used() const
+    {
+        std::lock_guard guard(lock);
+        return bytes_used;
+    }
+    inline i64 peak() const
+    {
+        std::lock_guard guard(lock);
+        return bytes_peak;
+    }
+
+private:
+    std::pmr::memory_resource* upstream;
+    i64 bytes_limit, bytes_used = 0, bytes_peak = 0;
+    std::chrono::steady_clock::time_point deadline;
+    // the functions of a parallel parse share it, their arenas only ask for chunks
+    mutable std::mutex lock;
+
+    void* do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void* ptr, size_t bytes, size_t align) override;
+    inline bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
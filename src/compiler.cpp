@@ -0,0 +1,102 @@
+#include "compiler.h"
+#include "vm.h"
+#include "x86.h"
+
+Compiler::Compiler(const CompileOptions& options)
+    : options(options)
+{
+}
+
+bool Compiler::compile(std::string_view source)
+{
+    reset();
+    this->source = source;
+    TokenList toks;
+    if (!toks.tokenize_view(this->source, options.jobs)) {
+        messages.emplace_back("unknown characters");
+        return false;
+    }
+    return parse(std::move(toks));
+}
+
+bool Compiler::compile_file(const std::filesystem::path& file)
+{
+    reset();
+    TokenList toks;
+    if (!toks.tokenize(file, options.jobs)) {
+        messages.emplace_back("failed to open " + file.string());
+        return false;
+    }
+    return parse(std::move(toks));
+}
+
+void Compiler::reset()
+{
+    parser.reset();
+    source = {};
+    messages = {};
+}
+
+bool Compiler::parse(TokenList&& toks)
+{
+    try {
+        parser.emplace(std::move(toks), options.memory);
+        if (parser->parse(options.jobs)) {
+            messages = parser->get_errors();
+            parser.reset();
+            return false;
+        }
+        if (options.opt)
+            parser->optimize();
+        return true;
+    } catch (const std::bad_alloc&) {
+        reset();
+        throw;
+    } catch (const std::exception& e) {
+        parser.reset();
+        messages.emplace_back(e.what());
+        return false;
+    }
+}
+
+// runs an output of the ir, what it throws becomes an error
+template <typename F>
+bool Compiler::output(F&& f)
+{
+    if (!parser) {
+        messages.emplace_back("nothing compiled");
+        return false;
+    }
+    try {
+        f();
+        return true;
+    } catch (const std::bad_alloc&) {
+        throw;
+    } catch (const std::exception& e) {
+        messages.emplace_back(e.what());
+        return false;
+    }
+}
+
+bool Compiler::ssa(std::ostream& os)
+{
+    return output([&]() {
+        for (auto& ssa : parser->get_ir())
+            os << ssa;
+    });
+}
+
+bool Compiler::dot(std::ostream& os)
+{
+    return output([&]() { parser->generate_dot(os); });
+}
+
+bool Compiler::assembly(std::ostream& os)
+{
+    return output([&]() { X86(parser->get_ir(), parser->get_functions()).emit_asm(os); });
+}
+
+bool Compiler::run(std::istream& in, std::ostream& out)
+{
+    return output([&]() { VM(parser->get_ir(), parser->get_functions()).run(in, out); });
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "parser.h"
+
+#include <filesystem>
+#include <iosfwd>
+
+struct CompileOptions {
+    unsigned jobs = 1; // threads the source is lexed and parsed on
+    bool opt = true;
+    // where the ir is allocated, a Budget to limit it
+    std::pmr::memory_resource* memory = std::pmr::get_default_resource();
+};
+
+// A compilation session for embedding the compiler. Every compile() replaces
+// the ir of the last one, which the session owns until then or reset(), and
+// nothing outlives the session. Errors come back from errors() as values,
+// only running out of memory, a BudgetExceeded among it, is thrown. Sessions
+// share no state, any number of them run at once on different threads.
+class Compiler {
+public:
+    Compiler(const CompileOptions& options = {});
+
+    // false with the errors set if the source does not compile
+    bool compile(std::string_view source);
+    bool compile_file(const std::filesystem::path& file);
+    // releases the source, ir and errors
+    void reset();
+
+    // whether the last compile succeeded
+    inline bool ok() const { return parser.has_value(); }
+    inline const std::vector<std::string>& errors() const { return messages; }
+    // of the last compile that succeeded
+    inline const std::deque<SSA>& ir() const { return parser->get_ir(); }
+    inline const FunctionMap& functions() const { return parser->get_functions(); }
+
+    // outputs of the ir, false with the error added if they fail
+    bool ssa(std::ostream& os);
+    bool dot(std::ostream& os);
+    bool assembly(std::ostream& os);
+    bool run(std::istream& in, std::ostream& out);
+
+private:
+    CompileOptions options;
+    std::string source; // the tokens point into it, outlives the parser
+    std::optional<Parser> parser;
+    std::vector<std::string> messages;
+
+    bool parse(TokenList&& toks);
+    template <typename F>
+    bool output(F&& f);
+};
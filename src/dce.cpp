@@ -0,0 +1,80 @@
+#include <algorithm>
+
+#include "opt.h"
+
+// instructions that are kept no matter if their value is read
+static bool is_root(InstrType type)
+{
+    switch (type) {
+    case InstrType::READ:
+    case InstrType::WRITE:
+    case InstrType::WRITENL:
+    case InstrType::JUMP:
+    case InstrType::SETP:
+    case InstrType::RET:
+    case InstrType::BRA:
+    case InstrType::END:
+        return true;
+    default:
+        break;
+    }
+    return isBranch(type);
+}
+
+// mark and sweep, everything not reachable through operands from a root is removed,
+// a division is a root unless its divisor is a constant other than 0, it has
+// to fail at run time like in the vm
+bool eliminate_dead_code(SSA& ssa)
+{
+    auto order = ssa.reverse_post_order();
+
+    std::unordered_map<u64, const Instr*> defs;
+    for (auto* b : order)
+        for (auto& instr : b->get_instructions())
+            defs[instr.pos] = &instr;
+
+    const auto may_trap = [&](const Instr& instr) {
+        if (instr.type != InstrType::DIV)
+            return false;
+        auto k = instr.y ? defs.find(*instr.y) : defs.end();
+        return k == defs.end() || k->second->type != InstrType::CONST || k->second->literal() == 0;
+    };
+
+    std::vector<const Instr*> worklist;
+    for (auto* b : order)
+        for (auto& instr : b->get_instructions())
+            if (is_root(instr.type) || may_trap(instr))
+                worklist.push_back(&instr);
+
+    std::unordered_set<u64> live;
+    for (auto* instr : worklist)
+        live.insert(instr->pos);
+
+    const auto mark = [&](std::optional<u64> v) {
+        if (!v)
+            return;
+        auto def = defs.find(*v);
+        if (def != defs.end() && live.insert(*v).second)
+            worklist.push_back(def->second);
+    };
+
+    while (!worklist.empty()) {
+        const Instr* instr = worklist.back();
+        worklist.pop_back();
+        if (instr->isValueX())
+            mark(instr->x);
+        if (instr->isValueY())
+            mark(instr->y);
+    }
+
+    bool changed = false;
+    for (auto* b : order) {
+        auto& instrs = b->get_instructions();
+        size_t before = instrs.size();
+        instrs.remove_if([&](const Instr& instr) {
+            return (instr.hasValue() || instr.type == InstrType::NONE) && !live.count(instr.pos);
+        });
+        changed |= instrs.size() != before;
+    }
+    return changed;
+}
@@ -0,0 +1,97 @@
+#include "dominance.h"
+#include "ssa.h"
+
+DominatorTree::DominatorTree(const std::vector<Block*>& order)
+    : order(order)
+    , nodes(order.size())
+{
+    for (u32 i = 0; i < order.size(); i++)
+        index[order[i]] = i;
+    for (auto* b : order)
+        for (auto* s : b->successors())
+            nodes[index.at(s)].preds.push_back(b);
+
+    // iterate to a fixpoint in reverse post order, u32(-1) is not yet processed
+    constexpr u32 none = -1;
+    for (auto& node : nodes)
+        node.idom = none;
+    if (order.empty())
+        return;
+    nodes[0].idom = 0;
+
+    const auto intersect = [&](u32 a, u32 b) {
+        while (a != b) {
+            while (a > b)
+                a = nodes[a].idom;
+            while (b > a)
+                b = nodes[b].idom;
+        }
+        return a;
+    };
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (u32 i = 1; i < order.size(); i++) {
+            u32 idom = none;
+            for (auto* p : nodes[i].preds) {
+                u32 j = index.at(p);
+                if (nodes[j].idom == none)
+                    continue;
+                idom = idom == none ? j : intersect(j, idom);
+            }
+            if (nodes[i].idom != idom) {
+                nodes[i].idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (u32 i = 1; i < order.size(); i++)
+        nodes[nodes[i].idom].children.push_back(order[i]);
+
+    // pre and post numbers of the tree, iteratively since blocks can nest deep
+    u32 pre = 0, post = 0;
+    std::vector<std::pair<u32, size_t>> stack = { { 0, 0 } }; // node, next child
+    nodes[0].pre = pre++;
+    while (!stack.empty()) {
+        auto& [n, next] = stack.back();
+        if (next < nodes[n].children.size()) {
+            u32 child = index.at(nodes[n].children[next++]);
+            nodes[child].pre = pre++;
+            stack.emplace_back(child, 0);
+        } else {
+            nodes[n].post = post++;
+            stack.pop_back();
+        }
+    }
+
+    // a join is in the frontier of every block on the way up from its predecessors to its idom
+    for (u32 i = 0; i < order.size(); i++) {
+        if (nodes[i].preds.size() < 2)
+            continue;
+        for (auto* p : nodes[i].preds) {
+            for (u32 runner = index.at(p); runner != nodes[i].idom; runner = nodes[runner].idom) {
+                auto& frontier = nodes[runner].frontier;
+                if (frontier.empty() || frontier.back() != order[i])
+                    frontier.push_back(order[i]);
+            }
+        }
+    }
+}
+
+Block* DominatorTree::idom(const Block* b) const
+{
+    auto it = index.find(b);
+    if (it == index.end() || it->second == 0)
+        return nullptr;
+    return order[nodes[it->second].idom];
+}
+
+bool DominatorTree::dominates(const Block* a, const Block* b) const
+{
+    auto ia = index.find(a), ib = index.find(b);
+    if (ia == index.end() || ib == index.end())
+        return false;
+    auto &na = nodes[ia->second], &nb = nodes[ib->second];
+    return na.pre <= nb.pre && nb.post <= na.post;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+class Block;
+
+// Dominator tree of the blocks reachable from the head (Cooper, Harvey &
+// Kennedy). Blocks are numbered in pre and post order of the tree so that
+// dominance is answered by comparing numbers.
+class DominatorTree {
+public:
+    // order is the reverse post order of the cfg, starting with the head
+    DominatorTree(const std::vector<Block*>& order);
+
+    inline bool contains(const Block* b) const { return index.count(b); }
+
+    // immediate dominator, nullptr for the head and unreachable blocks
+    Block* idom(const Block* b) const;
+
+    // true if every path from the head to b goes through a, a block dominates itself
+    bool dominates(const Block* a, const Block* b) const;
+    inline bool strictly_dominates(const Block* a, const Block* b) const { return a != b && dominates(a, b); }
+
+    // blocks immediately dominated by b in reverse post order
+    inline const std::vector<Block*>& children(const Block* b) const { return nodes[index.at(b)].children; }
+    // blocks where the dominance of b ends
+    inline const std::vector<Block*>& frontier(const Block* b) const { return nodes[index.at(b)].frontier; }
+    // reachable control flow predecessors
+    inline const std::vector<Block*>& predecessors(const Block* b) const { return nodes[index.at(b)].preds; }
+
+    inline const std::vector<Block*>& get_order() const { return order; }
+
+private:
+    struct Node {
+        u32 idom; // index into order
+        u32 pre, post;
+        std::vector<Block*> children, frontier, preds;
+    };
+
+    std::vector<Block*> order;
+    std::vector<Node> nodes; // by reverse post order
+    std::unordered_map<const Block*, u32> index;
+};
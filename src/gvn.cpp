@@ -0,0 +1,106 @@
+#include "opt.h"
+
+// arithmetic and compares, the same operands always give the same value
+static bool is_pure(InstrType type)
+{
+    switch (type) {
+    case InstrType::ADD:
+    case InstrType::SUB:
+    case InstrType::MUL:
+    case InstrType::DIV:
+    case InstrType::CMP:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+// One walk over the dominator tree. An expression is known in the blocks its
+// block dominates, so only a computation that ran on every path is reused.
+// Phis are only congruent to phis of the same block, the edges they select on
+// are the same there and nowhere else. Values replaced on a back edge are
+// resolved once the walk is done.
+static bool number_values_once(SSA& ssa)
+{
+    auto& dom = ssa.dominators();
+
+    std::unordered_map<u64, u64> replace; // removed value -> value it equals
+    const auto resolve = [&](ValueId& v) {
+        if (!v)
+            return;
+        for (auto it = replace.find(*v); it != replace.end(); it = replace.find(*v))
+            v = it->second;
+    };
+
+    ValueTable expressions;
+    // explicit stack, the tree of a long program is as deep as its statements
+    std::vector<std::pair<Block*, bool>> stack = { { ssa.get_head(), false } };
+    while (!stack.empty()) {
+        auto [b, leave] = stack.back();
+        stack.pop_back();
+        if (leave) {
+            expressions.pop_scope();
+            continue;
+        }
+        expressions.push_scope();
+        stack.emplace_back(b, true);
+
+        ValueTable phis;
+        for (auto& instr : b->get_instructions()) {
+            if (instr.isValueX())
+                resolve(instr.x);
+            if (instr.isValueY())
+                resolve(instr.y);
+
+            if (instr.type == InstrType::PHI) {
+                // one value on both edges, or one value and the phi itself around a loop
+                bool self_x = instr.x == ValueId(instr.pos), self_y = instr.y == ValueId(instr.pos);
+                if (instr.x && !self_x && (instr.x == instr.y || self_y)) {
+                    replace[instr.pos] = *instr.x;
+                    continue;
+                }
+                if (instr.y && !self_y && self_x) {
+                    replace[instr.pos] = *instr.y;
+                    continue;
+                }
+                if (auto same = phis.find(instr))
+                    replace[instr.pos] = *same;
+                else
+                    phis.insert(instr, instr.pos);
+            } else if (is_pure(instr.type)) {
+                if (auto same = expressions.find(instr))
+                    replace[instr.pos] = *same;
+                else
+                    expressions.insert(instr, instr.pos);
+            }
+        }
+
+        auto& children = dom.children(b);
+        for (auto it = children.rbegin(); it != children.rend(); ++it)
+            stack.emplace_back(*it, false);
+    }
+    if (replace.empty())
+        return false;
+
+    for (auto* b : dom.get_order()) {
+        auto& instrs = b->get_instructions();
+        instrs.remove_if([&](const Instr& instr) { return replace.count(instr.pos); });
+        for (auto& instr : instrs) {
+            if (instr.isValueX())
+                resolve(instr.x);
+            if (instr.isValueY())
+                resolve(instr.y);
+        }
+    }
+    return true;
+}
+
+// merged phis make their users equal in turn, walk again until nothing changes
+bool number_values(SSA& ssa)
+{
+    bool changed = false;
+    while (number_values_once(ssa))
+        changed = true;
+    return changed;
+}
@@ -0,0 +1,297 @@
+#include <algorithm>
+
+#include "opt.h"
+
+__extension__ typedef __int128 i128; // exact products of two i64
+
+// a * iv + b for the basic induction variable iv, in wrapping arithmetic
+struct Affine {
+    u64 iv;
+    i64 a, b;
+};
+
+// header phi stepped by a constant on the back edge
+struct Basic {
+    u64 inc; // value on the back edge
+    std::optional<u64> init;
+    i64 step;
+    std::optional<std::pair<i64, i64>> range; // values in the header if the trip count is bounded
+};
+
+static inline i64 wrap_add(i64 x, i64 y) { return (i64)((u64)x + (u64)y); }
+static inline i64 wrap_mul(i64 x, i64 y) { return (i64)((u64)x * (u64)y); }
+static inline bool fits(i128 v) { return v >= INT64_MIN && v <= INT64_MAX; }
+
+// true if a * x + b does not overflow for x in the range, it is monotone so the ends are enough
+static bool fits(const Affine& f, std::pair<i64, i64> range)
+{
+    return fits((i128)f.a * range.first + f.b) && fits((i128)f.a * range.second + f.b);
+}
+
+// Every value a * iv + b computed in the loop from a multiplication, or from a
+// division that is exact over the values the iv takes, is replaced by a new
+// header phi that starts at a * init + b and is stepped by a * step. The loop
+// test on the iv is then rewritten to compare one of those phis, leaving the iv
+// itself dead when nothing else reads it.
+bool reduce_induction_variables(SSA& ssa)
+{
+    auto& dom = ssa.dominators();
+
+    // copies, the blocks are changed while the loops are visited
+    std::unordered_map<u64, Instr> defs;
+    std::unordered_map<u64, Block*> def_block;
+    std::unordered_map<u64, std::vector<u64>> users;
+    for (auto* b : dom.get_order()) {
+        for (auto& instr : b->get_instructions()) {
+            defs[instr.pos] = instr;
+            def_block[instr.pos] = b;
+            if (instr.isValueX() && instr.x)
+                users[*instr.x].push_back(instr.pos);
+            if (instr.isValueY() && instr.y)
+                users[*instr.y].push_back(instr.pos);
+        }
+    }
+
+    // missing operands read as 0
+    const auto constant = [&](std::optional<u64> v) -> std::optional<i64> {
+        if (!v)
+            return 0;
+        auto def = defs.find(*v);
+        if (def == defs.end() || def->second.type != InstrType::CONST)
+            return std::nullopt;
+        return def->second.literal();
+    };
+
+    const auto add = [&](Block* b, InstrType type, std::optional<u64> x, std::optional<u64> y, bool front = false) {
+        Instr instr = {};
+        instr.pos = ssa.next_pos();
+        instr.type = type;
+        instr.x = x;
+        instr.y = y;
+        defs[instr.pos] = instr;
+        def_block[instr.pos] = b;
+        return (front ? b->add_front(std::move(instr)) : b->add_back(std::move(instr))).pos;
+    };
+
+    std::unordered_map<u64, u64> replace;
+    bool changed = false;
+
+    for (auto& loop : ssa.loops().get_loops()) {
+        Block* header = loop.header;
+        if (loop.latches.size() != 1 || !header->is_phi_y(loop.latches.front()))
+            continue;
+
+        std::unordered_map<u64, Basic> basics;
+        for (auto& instr : header->get_instructions()) {
+            if (instr.type != InstrType::PHI || !instr.y || !defs.count(*instr.y))
+                continue;
+            const Instr& inc = defs.at(*instr.y);
+            if (!loop.contains(def_block.at(inc.pos)))
+                continue;
+            std::optional<i64> step;
+            if (inc.type == InstrType::ADD && inc.x == instr.pos)
+                step = constant(inc.y);
+            else if (inc.type == InstrType::ADD && inc.y == instr.pos)
+                step = constant(inc.x);
+            else if (inc.type == InstrType::SUB && inc.x == instr.pos && constant(inc.y))
+                step = wrap_mul(-1, *constant(inc.y));
+            if (step && *step != 0)
+                basics[instr.pos] = { inc.pos, instr.x, *step, std::nullopt };
+        }
+        if (basics.empty())
+            continue;
+
+        // loop test of an iv against a constant bound c, bounds the values of the iv
+        // if it stops the loop once the iv went past c
+        struct {
+            u64 cmp, iv;
+            i64 bound;
+            bool iv_left;
+        } test = {};
+        bool has_test = false;
+        auto& hinstrs = header->get_instructions();
+        auto succ = header->successors();
+        if (!hinstrs.empty() && isBranch(hinstrs.back().type) && hinstrs.back().x && defs.count(*hinstrs.back().x)) {
+            const Instr& branch = hinstrs.back();
+            const Instr& cmp = defs.at(*branch.x);
+            bool taken_stays = loop.contains(succ[1]);
+            if (cmp.type == InstrType::CMP && def_block.at(cmp.pos) == header && loop.contains(succ[0]) != taken_stays) {
+                for (bool left : { true, false }) {
+                    auto iv = left ? cmp.x : cmp.y;
+                    auto bound = constant(left ? cmp.y : cmp.x);
+                    if (!iv || !basics.count(*iv) || !bound)
+                        continue;
+                    test = { cmp.pos, *iv, *bound, left };
+                    has_test = true;
+
+                    // does the loop go on for the iv below, at or above the bound
+                    const auto goes_on = [&](i64 sign) { return is_taken(branch.type, left ? sign : -sign) == taken_stays; };
+                    auto& basic = basics.at(*iv);
+                    auto init = constant(basic.init);
+                    i128 last = (i128)*bound + basic.step;
+                    if (!init || !fits(last))
+                        break;
+                    if (basic.step > 0 && !goes_on(1))
+                        basic.range = { *init, std::max<i64>(*init, (i64)last) };
+                    else if (basic.step < 0 && !goes_on(-1))
+                        basic.range = { std::min<i64>(*init, (i64)last), *init };
+                    break;
+                }
+            }
+        }
+
+        std::unordered_map<u64, Affine> affine;
+        for (auto& [phi, basic] : basics)
+            affine[phi] = { phi, 1, 0 };
+        std::vector<u64> candidates;
+        for (auto* b : loop.blocks) {
+            for (auto& instr : b->get_instructions()) {
+                auto fx = instr.x ? affine.find(*instr.x) : affine.end();
+                auto fy = instr.y ? affine.find(*instr.y) : affine.end();
+                auto kx = constant(instr.x), ky = constant(instr.y);
+                std::optional<Affine> f;
+                switch (instr.type) {
+                case InstrType::ADD:
+                    if (fx != affine.end() && ky)
+                        f = { fx->second.iv, fx->second.a, wrap_add(fx->second.b, *ky) };
+                    else if (fy != affine.end() && kx)
+                        f = { fy->second.iv, fy->second.a, wrap_add(*kx, fy->second.b) };
+                    else if (fx != affine.end() && fy != affine.end() && fx->second.iv == fy->second.iv)
+                        f = { fx->second.iv, wrap_add(fx->second.a, fy->second.a), wrap_add(fx->second.b, fy->second.b) };
+                    break;
+                case InstrType::SUB:
+                    if (fx != affine.end() && ky)
+                        f = { fx->second.iv, fx->second.a, wrap_add(fx->second.b, wrap_mul(-1, *ky)) };
+                    else if (fy != affine.end() && kx)
+                        f = { fy->second.iv, wrap_mul(-1, fy->second.a), wrap_add(*kx, wrap_mul(-1, fy->second.b)) };
+                    else if (fx != affine.end() && fy != affine.end() && fx->second.iv == fy->second.iv)
+                        f = { fx->second.iv, wrap_add(fx->second.a, wrap_mul(-1, fy->second.a)), wrap_add(fx->second.b, wrap_mul(-1, fy->second.b)) };
+                    break;
+                case InstrType::MUL:
+                    if (fx != affine.end() && ky)
+                        f = { fx->second.iv, wrap_mul(fx->second.a, *ky), wrap_mul(fx->second.b, *ky) };
+                    else if (fy != affine.end() && kx)
+                        f = { fy->second.iv, wrap_mul(*kx, fy->second.a), wrap_mul(*kx, fy->second.b) };
+                    break;
+                case InstrType::DIV: {
+                    // only exact if nothing overflows, then (a * iv + b) / k = a / k * iv + b / k
+                    if (fx == affine.end() || !ky || *ky == 0)
+                        break;
+                    auto& g = fx->second;
+                    auto& range = basics.at(g.iv).range;
+                    if (!range || !fits(g, *range))
+                        break;
+                    if (*ky == -1) {
+                        if (g.a != INT64_MIN && g.b != INT64_MIN)
+                            f = { g.iv, -g.a, -g.b };
+                    } else if (g.a % *ky == 0 && g.b % *ky == 0) {
+                        f = { g.iv, g.a / *ky, g.b / *ky };
+                    }
+                } break;
+                default:
+                    break;
+                }
+                if (!f)
+                    continue;
+                affine[instr.pos] = *f;
+                if ((instr.type == InstrType::MUL || instr.type == InstrType::DIV) && f->a != 0)
+                    candidates.push_back(instr.pos);
+            }
+        }
+
+        // values only read by other reduced values are left to die
+        std::unordered_set<u64> candidate_set(candidates.begin(), candidates.end());
+        std::vector<u64> reduce;
+        for (u64 c : candidates)
+            for (u64 user : users[c])
+                if (!candidate_set.count(user)) {
+                    reduce.push_back(c);
+                    break;
+                }
+        if (reduce.empty())
+            continue;
+
+        Block* pre = ensure_preheader(ssa, dom, loop);
+        if (!pre)
+            continue;
+        changed = true;
+
+        // one recurrence per distinct a * iv + b
+        std::map<std::tuple<u64, i64, i64>, u64> recurrences;
+        for (u64 c : reduce) {
+            auto& f = affine.at(c);
+            auto key = std::make_tuple(f.iv, f.a, f.b);
+            auto it = recurrences.find(key);
+            if (it != recurrences.end()) {
+                replace[c] = it->second;
+                continue;
+            }
+
+            auto& basic = basics.at(f.iv);
+            u64 start;
+            if (auto init = constant(basic.init)) {
+                start = get_const(ssa, wrap_add(wrap_mul(f.a, *init), f.b));
+            } else {
+                start = *basic.init;
+                if (f.a != 1)
+                    start = add(pre, InstrType::MUL, start, get_const(ssa, f.a));
+                if (f.b != 0)
+                    start = add(pre, InstrType::ADD, start, get_const(ssa, f.b));
+            }
+
+            // stepped right after the iv
+            u64 phi = add(header, InstrType::PHI, start, std::nullopt, true);
+            Block* inc_block = def_block.at(basic.inc);
+            auto& instrs = inc_block->get_instructions();
+            auto at = std::find_if(instrs.begin(), instrs.end(), [&](const Instr& instr) { return instr.pos == basic.inc; });
+            Instr next = {};
+            next.pos = ssa.next_pos();
+            next.type = InstrType::ADD;
+            next.x = phi;
+            next.y = get_const(ssa, wrap_mul(f.a, basic.step));
+            defs[next.pos] = next;
+            def_block[next.pos] = inc_block;
+            instrs.insert(at + 1, next);
+            for (auto& instr : header->get_instructions())
+                if (instr.pos == phi)
+                    instr.y = next.pos;
+
+            recurrences[key] = phi;
+            replace[c] = phi;
+        }
+
+        // linear function test replacement, the order of the values is kept
+        // as long as the recurrence does not overflow where the test is evaluated
+        if (!has_test)
+            continue;
+        auto& range = basics.at(test.iv).range;
+        for (auto& [key, phi] : recurrences) {
+            Affine f = { std::get<0>(key), std::get<1>(key), std::get<2>(key) };
+            if (f.iv != test.iv || !range || !fits(f, *range) || !fits((i128)f.a * test.bound + f.b))
+                continue;
+            u64 bound = get_const(ssa, f.a * test.bound + f.b);
+            for (auto& instr : header->get_instructions()) {
+                if (instr.pos != test.cmp)
+                    continue;
+                bool iv_left = test.iv_left == (f.a > 0);
+                instr.x = iv_left ? phi : bound;
+                instr.y = iv_left ? bound : phi;
+            }
+            break;
+        }
+    }
+
+    if (!changed)
+        return false;
+
+    for (auto* b : ssa.reverse_post_order()) {
+        for (auto& instr : b->get_instructions()) {
+            if (instr.isValueX() && instr.x && replace.count(*instr.x))
+                instr.x = replace.at(*instr.x);
+            if (instr.isValueY() && instr.y && replace.count(*instr.y))
+                instr.y = replace.at(*instr.y);
+        }
+    }
+    ssa.invalidate_cfg();
+    return true;
+}
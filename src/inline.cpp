@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <functional>
+
+#include "opt.h"
+
+// callees up to this size are always inlined, with a single call site up to the larger one
+#define INLINE_SIZE 32
+#define INLINE_SIZE_ONCE 256
+// callers stop taking more bodies past this size
+#define INLINE_CALLER_SIZE 4096
+
+// instructions that turn into code
+static size_t code_size(const SSA& ssa)
+{
+    size_t n = 0;
+    for (auto* b : ssa.reverse_post_order())
+        for (auto& instr : b->get_instructions())
+            switch (instr.type) {
+            case InstrType::CONST:
+            case InstrType::GETP:
+            case InstrType::PHI:
+            case InstrType::BRA:
+            case InstrType::NONE:
+                break;
+            default:
+                n++;
+            }
+    return n;
+}
+
+// Blocks every predecessor of returned from, like the join of an if whose arms
+// both return and the return funcEnd puts into it. Nothing reaches them.
+static std::unordered_set<const Block*> dead_blocks(const SSA& ssa)
+{
+    auto order = ssa.reverse_post_order();
+    std::unordered_map<const Block*, std::vector<const Block*>> preds;
+    for (auto* b : order)
+        for (auto* succ : b->successors())
+            preds[succ].push_back(b);
+
+    const auto returns = [](const Block* b) {
+        auto& instrs = b->get_instructions();
+        return std::any_of(instrs.begin(), instrs.end(), [](const Instr& instr) { return instr.type == InstrType::RET; });
+    };
+    // a loop header is seen before its back edge and stays live
+    std::unordered_set<const Block*> dead;
+    for (auto* b : order) {
+        auto& p = preds[b];
+        if (!p.empty() && std::all_of(p.begin(), p.end(), [&](const Block* pred) { return dead.count(pred) || returns(pred); }))
+            dead.insert(b);
+    }
+    return dead;
+}
+
+// the returns of the function that can be reached, at most a branch to the
+// join follows each of them, none if any return is followed by more
+static std::vector<const Instr*> live_returns(const SSA& ssa, const std::unordered_set<const Block*>& dead)
+{
+    std::vector<const Instr*> rets;
+    for (auto* b : ssa.reverse_post_order()) {
+        if (dead.count(b))
+            continue;
+        auto& instrs = b->get_instructions();
+        auto it = std::find_if(instrs.begin(), instrs.end(), [](const Instr& instr) { return instr.type == InstrType::RET; });
+        if (it == instrs.end())
+            continue;
+        if (std::any_of(std::next(it), instrs.end(), [](const Instr& instr) { return instr.type != InstrType::BRA; }))
+            return {};
+        rets.push_back(&*it);
+    }
+    return rets;
+}
+
+typedef Block* Block::*Link;
+
+// Clones the callee in place of the call: the block of the jump is split, the
+// instructions after it move into a continuation block that joins the blocks of
+// the returns, two at a time through join blocks in between. Values of the
+// callee get fresh numbers, its parameters are the arguments and its constants
+// move to the head of the caller. Returns the value of the call, a phi of the
+// returned values with more than one return.
+static u64 inline_call(SSA& caller, Block* b, u64 jump, const SSA& callee, const std::unordered_set<const Block*>& dead, const std::vector<const Instr*>& rets)
+{
+    auto& instrs = b->get_instructions();
+    auto at = std::find_if(instrs.begin(), instrs.end(), [&](const Instr& instr) { return instr.pos == jump; });
+
+    std::unordered_map<u64, u64> args; // param -> argument
+    auto first = at;
+    while (first != instrs.begin() && std::prev(first)->type == InstrType::SETP) {
+        --first;
+        args.emplace(*first->y, *first->x);
+    }
+
+    // continuation takes over the rest of the block and its successors
+    Block* cont = caller.new_block();
+    for (auto it = std::next(at); it != instrs.end(); ++it)
+        cont->add_back(std::move(*it));
+    for (Link link : { &Block::left, &Block::right, &Block::entry }) {
+        auto& succ = b->*link;
+        if (!succ)
+            continue;
+        for (auto* parent : { &succ->parent_left, &succ->parent_right })
+            if (*parent == b)
+                *parent = cont;
+        cont->*link = succ;
+        succ = nullptr;
+    }
+    instrs.erase(first, instrs.end());
+
+    auto order = callee.reverse_post_order();
+    std::unordered_map<u64, u64> values; // callee value -> caller value
+    std::unordered_map<const Block*, Block*> blocks;
+    order.erase(std::remove_if(order.begin(), order.end(), [&](const Block* cb) { return dead.count(cb); }), order.end());
+    for (auto* cb : order) {
+        blocks[cb] = caller.new_block();
+        for (auto& instr : cb->get_instructions()) {
+            if (instr.type == InstrType::CONST)
+                values[instr.pos] = get_const(caller, instr.literal());
+            else if (instr.type == InstrType::GETP)
+                values[instr.pos] = args.count(*instr.y) ? args.at(*instr.y) : get_const(caller, 0);
+            else
+                values[instr.pos] = caller.next_pos();
+        }
+    }
+
+    // numbers are per function, one the callee never defined must not turn
+    // into a value of the caller, it stays missing
+    const auto map = [&](ValueId& v) {
+        if (v)
+            v = values.count(*v) ? ValueId(values.at(*v)) : ValueId();
+    };
+    std::unordered_map<const Block*, const Instr*> ret_of;
+    for (auto* ret : rets)
+        for (auto* cb : order)
+            for (auto& instr : cb->get_instructions())
+                if (&instr == ret)
+                    ret_of[cb] = ret;
+    for (auto* cb : order) {
+        Block* clone = blocks.at(cb);
+        for (Link link : { &Block::left, &Block::right, &Block::parent_left, &Block::parent_right, &Block::entry }) {
+            auto target = blocks.find(cb->*link);
+            if (target != blocks.end())
+                clone->*link = target->second;
+        }
+        for (auto& orig : cb->get_instructions()) {
+            if (ret_of.count(cb) && &orig == ret_of.at(cb))
+                break;
+            if (orig.type == InstrType::CONST || orig.type == InstrType::GETP)
+                continue;
+            Instr instr = orig;
+            instr.pos = values.at(instr.pos);
+            // jump targets of branches are renamed along with the values
+            if (instr.type != InstrType::JUMP)
+                map(instr.x);
+            if (instr.type != InstrType::SETP)
+                map(instr.y);
+            clone->add_back(std::move(instr));
+        }
+    }
+
+    Block* entry = blocks.at(order.front());
+    b->left = entry;
+    entry->parent_left = b;
+
+    // a void return reads as zero
+    const auto value = [&](const Instr* ret) {
+        if (ret->x && values.count(*ret->x))
+            return values.at(*ret->x);
+        return get_const(caller, 0);
+    };
+
+    // the edges behind the returns were never taken
+    std::vector<std::pair<Block*, u64>> exits;
+    for (auto& [cb, ret] : ret_of) {
+        Block* exit = blocks.at(cb);
+        for (Link link : { &Block::left, &Block::right, &Block::entry }) {
+            auto& succ = exit->*link;
+            if (!succ)
+                continue;
+            for (auto* parent : { &succ->parent_left, &succ->parent_right })
+                if (*parent == exit)
+                    *parent = nullptr;
+            succ = nullptr;
+        }
+        exits.emplace_back(exit, value(ret));
+    }
+    std::sort(exits.begin(), exits.end(), [](auto& l, auto& r) { return l.first->get_block_id() < r.first->get_block_id(); });
+
+    auto exit = exits.front();
+    if (exits.size() == 1) {
+        exit.first->left = cont;
+        cont->parent_left = exit.first;
+        return exit.second;
+    }
+    for (size_t i = 1; i < exits.size(); i++) {
+        Block* join = i + 1 == exits.size() ? cont : caller.new_block();
+        join->parent_left = exit.first;
+        join->parent_right = exits[i].first;
+        exit.first->right = join;
+        exits[i].first->left = join;
+
+        Instr phi = {};
+        phi.pos = caller.next_pos();
+        phi.type = InstrType::PHI;
+        phi.x = exit.second;
+        phi.y = exits[i].second;
+        exit = { join, join->add_front(std::move(phi)).pos };
+    }
+    return exit.second;
+}
+
+// Bottom up over the call graph so callees already carry the bodies of their
+// own callees when they are copied. Recursive functions are never inlined.
+bool inline_functions(std::deque<SSA>& ir, const FunctionMap& functions)
+{
+    std::unordered_map<u64, u64> targets; // jump pos -> index in ir
+    for (auto& [_, f] : functions)
+        targets[f.pos] = f.index;
+
+    std::vector<std::vector<u64>> calls(ir.size());
+    std::vector<size_t> sites(ir.size());
+    for (u64 i = 0; i < ir.size(); i++) {
+        for (auto* b : ir[i].reverse_post_order()) {
+            for (auto& instr : b->get_instructions()) {
+                if (instr.type != InstrType::JUMP || !targets.count(*instr.x))
+                    continue;
+                calls[i].push_back(targets.at(*instr.x));
+                sites[targets.at(*instr.x)]++;
+            }
+        }
+    }
+
+    std::vector<bool> recursive(ir.size());
+    for (u64 i = 0; i < ir.size(); i++) {
+        std::vector<bool> seen(ir.size());
+        std::vector<u64> stack(calls[i].begin(), calls[i].end());
+        while (!stack.empty() && !recursive[i]) {
+            u64 f = stack.back();
+            stack.pop_back();
+            recursive[i] = f == i;
+            if (seen[f])
+                continue;
+            seen[f] = true;
+            stack.insert(stack.end(), calls[f].begin(), calls[f].end());
+        }
+    }
+
+    std::vector<u64> order;
+    std::vector<bool> visited(ir.size());
+    std::function<void(u64)> post = [&](u64 f) {
+        if (visited[f])
+            return;
+        visited[f] = true;
+        for (u64 g : calls[f])
+            post(g);
+        order.push_back(f);
+    };
+    for (u64 i = 0; i < ir.size(); i++)
+        post(i);
+
+    bool changed = false;
+    for (u64 f : order) {
+        SSA& caller = ir[f];
+        size_t size = code_size(caller);
+        std::unordered_map<u64, u64> replace;
+        for (bool inlined = true; inlined;) {
+            inlined = false;
+            for (auto* b : caller.reverse_post_order()) {
+                for (auto& instr : b->get_instructions()) {
+                    if (instr.type != InstrType::JUMP || !targets.count(*instr.x))
+                        continue;
+                    u64 g = targets.at(*instr.x);
+                    const SSA& callee = ir[g];
+                    auto dead = dead_blocks(callee);
+                    auto rets = live_returns(callee, dead);
+                    size_t callee_size = code_size(callee);
+                    if (recursive[g] || rets.empty() || size + callee_size > INLINE_CALLER_SIZE)
+                        continue;
+                    if (callee_size > (sites[g] == 1 ? INLINE_SIZE_ONCE : INLINE_SIZE))
+                        continue;
+                    u64 jump = instr.pos; // erased by the split
+                    replace[jump] = inline_call(caller, b, jump, callee, dead, rets);
+                    size += callee_size;
+                    inlined = true;
+                    break;
+                }
+                if (inlined)
+                    break;
+            }
+            changed |= inlined;
+        }
+        if (replace.empty())
+            continue;
+
+        const auto resolve = [&](ValueId& v) {
+            if (!v)
+                return;
+            for (auto it = replace.find(*v); it != replace.end(); it = replace.find(*v))
+                v = it->second;
+        };
+        for (auto* b : caller.reverse_post_order()) {
+            for (auto& instr : b->get_instructions()) {
+                if (instr.isValueX())
+                    resolve(instr.x);
+                if (instr.isValueY())
+                    resolve(instr.y);
+            }
+        }
+        caller.invalidate_cfg();
+    }
+    return changed;
+}
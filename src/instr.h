@@ -0,0 +1,218 @@
+#pragma once
+
+#include <iostream>
+
+enum class InstrType : u8 {
+    CONST, // const #x define an SSA value for a constant
+    ADD, // add x y addition
+    SUB, // sub x y subtraction
+    MUL, // mul x y multiplication
+    DIV, // div x y division
+    CMP, // cmp x y comparison
+    PHI, // phi x1 x2 compute Phi(x1,    x2)
+    BRA, // bra y branch to y
+    BNE, // bne x y branch to y on x not equal
+    BEQ, // beq x y branch to y on x equal
+    BLE, // ble x y branch to y on x less or equal
+    BLT, // blt x y branch to y on x less
+    BGE, // bge x y branch to y on x greater or equal
+    BGT, // bgt x y branch to y on x greater
+
+    // Inbuilt Functions
+    READ,
+    WRITE,
+    WRITENL,
+
+    // Functions
+    JUMP,
+    RET,
+    SETP,
+    GETP,
+
+    END,
+    NONE,
+    UNKNOWN,
+};
+
+inline bool isBranch(InstrType type)
+{
+    switch (type) {
+    case InstrType::BNE:
+    case InstrType::BEQ:
+    case InstrType::BLE:
+    case InstrType::BLT:
+    case InstrType::BGT:
+    case InstrType::BGE:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+inline bool isCommutative(InstrType type)
+{
+    return type == InstrType::ADD || type == InstrType::MUL;
+}
+
+// 32 bit number of the instruction that defines a value, behaves like an
+// optional so missing operands stay missing
+struct ValueId {
+    static constexpr u32 NONE = UINT32_MAX;
+    u32 id = NONE;
+
+    ValueId() = default;
+    ValueId(std::nullopt_t) { }
+    ValueId(u64 v)
+        : id((u32)v)
+    {
+        assert(v < NONE && "instruction number out of range");
+    }
+    ValueId(const std::optional<u64>& v)
+        : id(v ? (u32)*v : NONE)
+    {
+        assert(!v || *v < NONE);
+    }
+
+    inline bool has_value() const { return id != NONE; }
+    explicit inline operator bool() const { return has_value(); }
+    inline u64 operator*() const { return id; }
+    inline u64 value() const
+    {
+        assert(has_value());
+        return id;
+    }
+    inline u64 value_or(u64 v) const { return has_value() ? id : v; }
+    inline operator std::optional<u64>() const
+    {
+        if (!has_value())
+            return std::nullopt;
+        return id;
+    }
+
+    friend inline bool operator==(ValueId a, ValueId b) { return a.id == b.id; }
+    friend inline bool operator!=(ValueId a, ValueId b) { return a.id != b.id; }
+};
+
+// 16 bytes, a const keeps its literal split over x and y
+struct Instr {
+    u32 pos = 0;
+    InstrType type = InstrType::NONE;
+    ValueId x, y;
+    // same expression, operands of commutative opcodes may be swapped
+    bool operator==(const Instr& other) const
+    {
+        if (type != other.type) return false;
+
+        if (x == other.x && y == other.y) return true;
+        if (isCommutative(type) && x == other.y && y == other.x) return true;
+        return false;
+    }
+
+    inline i64 literal() const
+    {
+        assert(type == InstrType::CONST);
+        return (i64)((u64)y.id << 32 | x.id);
+    }
+    inline void set_literal(i64 val)
+    {
+        type = InstrType::CONST;
+        x.id = (u32)(u64)val;
+        y.id = (u32)((u64)val >> 32);
+    }
+
+    inline bool isHashable() const
+    {
+        switch (this->type) {
+        case InstrType::ADD:
+        case InstrType::SUB:
+        case InstrType::MUL:
+        case InstrType::DIV:
+            return true;
+        case InstrType::JUMP:
+        case InstrType::SETP:
+        case InstrType::GETP:
+        case InstrType::RET:
+        case InstrType::PHI:
+        case InstrType::CMP:
+        case InstrType::BRA:
+        case InstrType::BNE:
+        case InstrType::BEQ:
+        case InstrType::BLE:
+        case InstrType::BLT:
+        case InstrType::BGE:
+        case InstrType::BGT:
+        case InstrType::READ:
+        case InstrType::WRITE:
+        case InstrType::WRITENL:
+        case InstrType::END:
+        case InstrType::CONST:
+        case InstrType::NONE:
+        case InstrType::UNKNOWN:
+            break;
+        }
+        return false;
+    }
+
+    // true if the instruction defines an ssa value
+    inline bool hasValue() const
+    {
+        switch (this->type) {
+        case InstrType::CONST:
+        case InstrType::ADD:
+        case InstrType::SUB:
+        case InstrType::MUL:
+        case InstrType::DIV:
+        case InstrType::CMP:
+        case InstrType::PHI:
+        case InstrType::READ:
+        case InstrType::JUMP:
+        case InstrType::GETP:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    // true if x refers to an ssa value (and not a literal or jump target)
+    inline bool isValueX() const
+    {
+        switch (this->type) {
+        case InstrType::ADD:
+        case InstrType::SUB:
+        case InstrType::MUL:
+        case InstrType::DIV:
+        case InstrType::CMP:
+        case InstrType::PHI:
+        case InstrType::WRITE:
+        case InstrType::SETP:
+        case InstrType::RET:
+            return true;
+        default:
+            break;
+        }
+        return isBranch(this->type);
+    }
+
+    // true if y refers to an ssa value (and not a literal or jump target)
+    inline bool isValueY() const
+    {
+        switch (this->type) {
+        case InstrType::ADD:
+        case InstrType::SUB:
+        case InstrType::MUL:
+        case InstrType::DIV:
+        case InstrType::CMP:
+        case InstrType::PHI:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const Instr& instr);
+};
+
+static_assert(sizeof(Instr) == 16);
@@ -0,0 +1,240 @@
+#include "jit.h"
+#include "runtime.h"
+
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// x86-64 encoder for the MInstr forms produced by X86, every instruction is 64 bit (REX.W)
+class Encoder {
+public:
+    std::vector<u8> buf;
+
+    inline void byte(u8 b) { buf.push_back(b); }
+
+    inline void imm32(i64 v)
+    {
+        for (int i = 0; i < 4; i++)
+            byte((u32)v >> (8 * i));
+    }
+
+    inline void imm64(i64 v)
+    {
+        for (int i = 0; i < 8; i++)
+            byte((u64)v >> (8 * i));
+    }
+
+    inline void patch32(size_t at, i64 v)
+    {
+        for (int i = 0; i < 4; i++)
+            buf[at + i] = (u32)v >> (8 * i);
+    }
+
+    // REX.W opcode modrm [sib] [disp], reg is a register number or an opcode extension
+    void op_rm(std::initializer_list<u8> opcode, u8 reg, const Operand& rm)
+    {
+        u8 base = (u8)rm.reg;
+        byte(0x48 | ((reg >> 3) & 1) << 2 | ((base >> 3) & 1));
+        for (auto o : opcode)
+            byte(o);
+
+        if (rm.isReg()) {
+            byte(0xC0 | (reg & 7) << 3 | (base & 7));
+            return;
+        }
+
+        assert(rm.isMem());
+        i64 disp = rm.val;
+        u8 mod = disp >= INT8_MIN && disp <= INT8_MAX ? 0x40 : 0x80;
+        if (disp == 0 && (base & 7) != 5) // rbp and r13 always need a displacement
+            mod = 0x00;
+        byte(mod | (reg & 7) << 3 | (base & 7));
+        if ((base & 7) == 4) // rsp and r12 need a sib byte
+            byte(0x24);
+        if (mod == 0x40)
+            byte((i8)disp);
+        else if (mod == 0x80)
+            imm32(disp);
+    }
+
+    // add, sub and cmp share their encodings apart from the opcode and extension
+    void alu(u8 rm_r, u8 r_rm, u8 ext, const MInstr& i)
+    {
+        if (i.src.isImm()) {
+            assert(i.src.isImm32());
+            op_rm({ 0x81 }, ext, i.dst);
+            imm32(i.src.val);
+        } else if (i.src.isMem()) {
+            op_rm({ r_rm }, (u8)i.dst.reg, i.src);
+        } else {
+            op_rm({ rm_r }, (u8)i.src.reg, i.dst);
+        }
+    }
+};
+
+JIT::JIT(const X86& x86)
+{
+#if defined(__x86_64__)
+    Encoder e;
+    const auto& functions = x86.get_functions();
+
+    std::vector<size_t> starts(functions.size());
+    std::vector<std::pair<size_t, u32>> calls; // rel32 offset -> function
+
+    for (size_t f = 0; f < functions.size(); f++) {
+        while (e.buf.size() % 16)
+            e.byte(0xCC);
+        starts[f] = e.buf.size();
+
+        std::vector<size_t> labels(functions[f].labels);
+        std::vector<std::pair<size_t, u32>> jumps; // rel32 offset -> label
+
+        for (const auto& i : functions[f].code) {
+            switch (i.op) {
+            case MOp::MOV:
+                if (i.src.isImm() && i.dst.isReg() && !i.src.isImm32()) {
+                    e.byte(0x48 | ((u8)i.dst.reg >> 3));
+                    e.byte(0xB8 | ((u8)i.dst.reg & 7));
+                    e.imm64(i.src.val);
+                } else if (i.src.isImm()) {
+                    e.op_rm({ 0xC7 }, 0, i.dst);
+                    e.imm32(i.src.val);
+                } else if (i.src.isMem()) {
+                    e.op_rm({ 0x8B }, (u8)i.dst.reg, i.src);
+                } else {
+                    e.op_rm({ 0x89 }, (u8)i.src.reg, i.dst);
+                }
+                break;
+            case MOp::ADD:
+                e.alu(0x01, 0x03, 0, i);
+                break;
+            case MOp::SUB:
+                e.alu(0x29, 0x2B, 5, i);
+                break;
+            case MOp::CMP:
+                e.alu(0x39, 0x3B, 7, i);
+                break;
+            case MOp::IMUL:
+                if (i.src.isImm()) {
+                    assert(i.src.isImm32());
+                    e.op_rm({ 0x69 }, (u8)i.dst.reg, i.dst);
+                    e.imm32(i.src.val);
+                } else {
+                    e.op_rm({ 0x0F, 0xAF }, (u8)i.dst.reg, i.src);
+                }
+                break;
+            case MOp::CQO:
+                e.byte(0x48);
+                e.byte(0x99);
+                break;
+            case MOp::IDIV:
+                e.op_rm({ 0xF7 }, 7, i.dst);
+                break;
+            case MOp::SETCC:
+                // REX.W is ignored, any REX selects spl, bpl, sil and dil over ah..bh
+                e.op_rm({ 0x0F, (u8)(0x90 | (u8)i.cc) }, 0, i.dst);
+                break;
+            case MOp::MOVZB:
+                e.op_rm({ 0x0F, 0xB6 }, (u8)i.dst.reg, i.src);
+                break;
+            case MOp::PUSH:
+            case MOp::POP:
+                if ((u8)i.dst.reg >= 8)
+                    e.byte(0x41);
+                e.byte((i.op == MOp::PUSH ? 0x50 : 0x58) | ((u8)i.dst.reg & 7));
+                break;
+            case MOp::JMP:
+                e.byte(0xE9);
+                jumps.emplace_back(e.buf.size(), i.dst.val);
+                e.imm32(0);
+                break;
+            case MOp::JCC:
+                e.byte(0x0F);
+                e.byte(0x80 | (u8)i.cc);
+                jumps.emplace_back(e.buf.size(), i.dst.val);
+                e.imm32(0);
+                break;
+            case MOp::CALL:
+                if (i.dst.kind == Operand::Kind::FUNC) {
+                    e.byte(0xE8);
+                    calls.emplace_back(e.buf.size(), i.dst.val);
+                    e.imm32(0);
+                } else {
+                    // the runtime may be further than rel32 away, call through r11
+                    uintptr_t target = 0;
+                    switch ((Runtime)i.dst.val) {
+                    case Runtime::READ:
+                        target = (uintptr_t)&ty_read;
+                        break;
+                    case Runtime::WRITE:
+                        target = (uintptr_t)&ty_write;
+                        break;
+                    case Runtime::WRITENL:
+                        target = (uintptr_t)&ty_writeNL;
+                        break;
+                    case Runtime::DIV_ZERO:
+                        target = (uintptr_t)&ty_div_zero;
+                        break;
+                    }
+                    e.byte(0x49);
+                    e.byte(0xBB);
+                    e.imm64(target);
+                    e.byte(0x41);
+                    e.byte(0xFF);
+                    e.byte(0xD3);
+                }
+                break;
+            case MOp::RET:
+                e.byte(0xC3);
+                break;
+            case MOp::LABEL:
+                labels[i.dst.val] = e.buf.size();
+                break;
+            }
+        }
+
+        for (auto& [at, label] : jumps)
+            e.patch32(at, (i64)labels[label] - (i64)(at + 4));
+    }
+
+    for (auto& [at, f] : calls)
+        e.patch32(at, (i64)starts[f] - (i64)(at + 4));
+
+    code_size = e.buf.size();
+    main_offset = starts[0];
+
+    // write then flip to executable, the mapping is never writable and executable at once
+    size_t page = sysconf(_SC_PAGESIZE);
+    mem_size = (code_size + page - 1) / page * page;
+    void* p = mmap(nullptr, mem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        throw std::runtime_error("failed to map jit memory");
+    mem = (u8*)p;
+    std::memcpy(mem, e.buf.data(), code_size);
+    if (mprotect(mem, mem_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, mem_size);
+        mem = nullptr;
+        throw std::runtime_error("failed to make jit memory executable");
+    }
+#else
+    (void)x86;
+    throw std::runtime_error("jit requires an x86-64 host");
+#endif
+}
+
+JIT::~JIT()
+{
+    if (mem)
+        munmap(mem, mem_size);
+}
+
+void JIT::run(std::FILE* in, std::FILE* out)
+{
+    auto entry = (int (*)(void))(mem + main_offset);
+    ty_set_io(in, out);
+    const char* error = ty_call(entry);
+    std::fflush(out);
+    ty_set_io(nullptr, nullptr);
+    if (error)
+        throw std::runtime_error(error);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdio>
+
+#include "x86.h"
+
+// Encodes the x86 lowering straight into executable memory and runs it in process.
+class JIT {
+public:
+    JIT(const X86& x86);
+    ~JIT();
+
+    // calls main, the builtins read from in and write to out, a runtime error
+    // of the program is thrown as std::runtime_error like the vm does
+    void run(std::FILE* in = stdin, std::FILE* out = stdout);
+
+    inline size_t size() const { return code_size; }
+
+private:
+    JIT(JIT&) = delete;
+
+    u8* mem = nullptr;
+    size_t mem_size = 0;
+    size_t code_size = 0;
+    size_t main_offset = 0;
+};
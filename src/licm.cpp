@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include "opt.h"
+
+static bool is_hoistable(InstrType type)
+{
+    switch (type) {
+    case InstrType::ADD:
+    case InstrType::SUB:
+    case InstrType::MUL:
+    case InstrType::DIV:
+    case InstrType::CMP:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+static bool is_observable(InstrType type)
+{
+    switch (type) {
+    case InstrType::READ:
+    case InstrType::WRITE:
+    case InstrType::WRITENL:
+    case InstrType::JUMP:
+    case InstrType::RET:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+// Loops are visited outer first so values invariant in several loops are hoisted
+// out of all of them at once. Arithmetic can be executed speculatively, division
+// only by a constant that can not trap or from the header before anything
+// observable happened, the header runs on every entry of the loop.
+bool hoist_loop_invariants(SSA& ssa)
+{
+    auto& dom = ssa.dominators();
+
+    std::unordered_map<u64, const Block*> def_block;
+    std::unordered_map<u64, i64> consts;
+    for (auto* b : dom.get_order()) {
+        for (auto& instr : b->get_instructions()) {
+            def_block[instr.pos] = b;
+            if (instr.type == InstrType::CONST)
+                consts[instr.pos] = instr.literal();
+        }
+    }
+
+    bool changed = false;
+    for (auto& loop : ssa.loops().get_loops()) {
+        std::unordered_set<u64> invariant;
+        std::vector<Instr> hoisted;
+        const auto is_invariant = [&](std::optional<u64> v) {
+            if (!v || invariant.count(*v))
+                return true;
+            auto def = def_block.find(*v);
+            return def != def_block.end() && !loop.contains(def->second);
+        };
+
+        for (auto* b : loop.blocks) {
+            auto& instrs = b->get_instructions();
+            const Instr* branch = !instrs.empty() && isBranch(instrs.back().type) ? &instrs.back() : nullptr;
+            bool observed = false;
+            for (auto& instr : instrs) {
+                observed |= is_observable(instr.type);
+                if (!is_hoistable(instr.type) || !is_invariant(instr.x) || !is_invariant(instr.y))
+                    continue;
+                // stays next to its branch so the backends can fuse them
+                if (instr.type == InstrType::CMP && branch && branch->x == instr.pos)
+                    continue;
+                if (instr.type == InstrType::DIV) {
+                    auto k = instr.y ? consts.find(*instr.y) : consts.end();
+                    bool safe_divisor = k != consts.end() && k->second != 0 && k->second != -1;
+                    if (!safe_divisor && (b != loop.header || observed))
+                        continue;
+                }
+                invariant.insert(instr.pos);
+                hoisted.push_back(instr);
+            }
+        }
+        if (hoisted.empty())
+            continue;
+
+        Block* pre = ensure_preheader(ssa, dom, loop);
+        if (!pre)
+            continue;
+        for (auto& instr : hoisted) {
+            def_block[instr.pos] = pre;
+            pre->add_back(std::move(instr));
+        }
+        for (auto* b : loop.blocks) {
+            auto& instrs = b->get_instructions();
+            instrs.remove_if([&](const Instr& instr) { return invariant.count(instr.pos); });
+        }
+        changed = true;
+    }
+
+    if (changed)
+        ssa.invalidate_cfg();
+    return changed;
+}
@@ -0,0 +1,59 @@
+#include "loop.h"
+#include "ssa.h"
+
+#include <algorithm>
+
+LoopNest::LoopNest(const DominatorTree& dom)
+{
+    auto& order = dom.get_order();
+    std::unordered_map<const Block*, u32> rpo;
+    for (u32 i = 0; i < order.size(); i++)
+        rpo[order[i]] = i;
+
+    // headers dominate their loops so they come out in reverse post order with the outer loops first
+    for (auto* h : order) {
+        Loop* loop = nullptr;
+        for (auto* p : dom.predecessors(h)) {
+            if (!dom.dominates(h, p))
+                continue;
+            if (!loop) {
+                loop = &loops.emplace_back();
+                loop->header = h;
+                loop->members.insert(h);
+                loop->blocks.push_back(h);
+            }
+            loop->latches.push_back(p);
+
+            // everything reaching the latch without passing the header
+            std::vector<Block*> stack = { p };
+            while (!stack.empty()) {
+                Block* b = stack.back();
+                stack.pop_back();
+                if (!loop->members.insert(b).second)
+                    continue;
+                loop->blocks.push_back(b);
+                for (auto* pred : dom.predecessors(b))
+                    stack.push_back(pred);
+            }
+        }
+        if (!loop)
+            continue;
+
+        std::sort(loop->blocks.begin(), loop->blocks.end(), [&](Block* a, Block* b) { return rpo.at(a) < rpo.at(b); });
+
+        // outer loops were numbered already, so the innermost one seen so far is the parent
+        loop->parent = loop_of(h);
+        if (loop->parent) {
+            loop->parent->children.push_back(loop);
+            loop->depth = loop->parent->depth + 1;
+        }
+        for (auto* b : loop->blocks)
+            innermost[b] = loop;
+    }
+}
+
+Loop* LoopNest::loop_of(const Block* b) const
+{
+    auto it = innermost.find(b);
+    return it == innermost.end() ? nullptr : it->second;
+}
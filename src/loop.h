@@ -0,0 +1,37 @@
+#pragma once
+
+class Block;
+class DominatorTree;
+
+// natural loop of a back edge, loops sharing a header are merged
+struct Loop {
+    Block* header;
+    Loop* parent = nullptr;
+    std::vector<Loop*> children;
+    std::vector<Block*> blocks; // header first, in reverse post order
+    std::vector<Block*> latches; // sources of the back edges
+    u32 depth = 1;
+
+    inline bool contains(const Block* b) const { return members.count(b); }
+
+private:
+    std::unordered_set<const Block*> members;
+    friend class LoopNest;
+};
+
+// Loop nest tree built from the back edges of the dominator tree, an edge
+// b -> h is a back edge if h dominates b.
+class LoopNest {
+public:
+    LoopNest(const DominatorTree& dom);
+
+    // innermost loop containing b, nullptr outside of loops
+    Loop* loop_of(const Block* b) const;
+
+    // outer loops come before the loops they contain
+    inline const std::deque<Loop>& get_loops() const { return loops; }
+
+private:
+    std::deque<Loop> loops;
+    std::unordered_map<const Block*, Loop*> innermost;
+};
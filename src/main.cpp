@@ -1,19 +1,171 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 
 #include "token.h"
+#include "batch.h"
 #include "parser.h"
+#include "server.h"
+#include "jit.h"
+#include "vm.h"
+#include "x86.h"
 
-#define USAGE_MSG "USAGE: tc <file>"
+#define USAGE_MSG "USAGE: ty [-O0] [-j <jobs>] [--run | --jit | -S [-o <out>]] <file>\n"        \
+                  "       ty --batch <dir | list> [-O0] [-j <jobs>] [-S] [-o <out dir>]\n"     \
+                  "       ty --serve <socket> [-j <jobs>] [--budget-ms <ms>] [--budget-mb <mb>]\n" \
+                  "       ty --connect <socket> [-O0] [-S | --ir] <file>"
+
+static Server* server = nullptr;
+
+// a whole number from 1 to max, nothing for anything else
+static std::optional<unsigned long> parse_count(const char* s, unsigned long max)
+{
+    char* end;
+    errno = 0;
+    unsigned long v = strtoul(s, &end, 10);
+    if (!isdigit((unsigned char)*s) || *end || errno || v == 0 || v > max)
+        return std::nullopt;
+    return v;
+}
+
+static int serve(const char* socket, const ServeOptions& options)
+{
+    Server s(socket, options);
+    server = &s;
+    std::signal(SIGINT, [](int) { server->stop(); });
+    std::signal(SIGTERM, [](int) { server->stop(); });
+    if (!s.run()) {
+        std::cerr << "Failed to listen on " << socket << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// compiles the file on a server and prints what it returns
+static int connect(const char* socket, const char* path, ServeOutput output, bool opt)
+{
+    std::ifstream is(path);
+    if (!is) {
+        std::cerr << "Failed to open file: " << path << std::endl;
+        return 1;
+    }
+    std::stringstream source;
+    source << is.rdbuf();
+
+    ServeClient client;
+    if (!client.connect(socket)) {
+        std::cerr << "Failed to connect to " << socket << std::endl;
+        return 1;
+    }
+    auto response = client.compile(source.str(), output, opt);
+    if (!response) {
+        std::cerr << "Lost the connection to " << socket << std::endl;
+        return 1;
+    }
+    auto& [status, out] = *response;
+    (status == ServeStatus::OK ? std::cout : std::cerr) << out;
+    if (status != ServeStatus::OK)
+        std::cerr << std::endl;
+    return status != ServeStatus::OK;
+}
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
+    bool run = false;
+    bool assembly = false;
+    bool jit = false;
+    bool opt = true;
+    bool batch = false;
+    bool ir = false;
+    const char* serve_socket = nullptr;
+    const char* connect_socket = nullptr;
+    ServeOptions serve_options;
+    const char* path = nullptr;
+    const char* out_path = nullptr;
+    unsigned jobs = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O0") == 0) {
+            opt = false;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            jit = true;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_socket = argv[++i];
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connect_socket = argv[++i];
+        } else if (strcmp(argv[i], "--budget-ms") == 0 && i + 1 < argc) {
+            auto ms = parse_count(argv[++i], INT32_MAX);
+            if (!ms) {
+                std::cerr << "Invalid --budget-ms: " << argv[i] << std::endl;
+                return 1;
+            }
+            serve_options.budget_time = std::chrono::milliseconds(*ms);
+        } else if (strcmp(argv[i], "--budget-mb") == 0 && i + 1 < argc) {
+            auto mb = parse_count(argv[++i], SIZE_MAX >> 20);
+            if (!mb) {
+                std::cerr << "Invalid --budget-mb: " << argv[i] << std::endl;
+                return 1;
+            }
+            serve_options.budget_bytes = (size_t)*mb << 20;
+        } else if (strcmp(argv[i], "--ir") == 0) {
+            ir = true;
+        } else if (strcmp(argv[i], "-S") == 0) {
+            assembly = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            auto j = parse_count(argv[++i], UINT32_MAX);
+            if (!j) {
+                std::cerr << "Invalid -j: " << argv[i] << std::endl;
+                return 1;
+            }
+            jobs = *j;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            std::cout << USAGE_MSG << std::endl;
+            return 1;
+        }
+    }
+
+    if (serve_socket && !path) {
+        serve_options.jobs = jobs;
+        return serve(serve_socket, serve_options);
+    }
+
+    if (!path || run + assembly + jit + ir > 1 || (batch && (run || jit)) || (ir && !connect_socket)) {
         std::cout << USAGE_MSG << std::endl;
         return 1;
     }
 
-    std::filesystem::path file = argv[1];
+    if (connect_socket)
+        return connect(connect_socket, path, assembly ? ServeOutput::ASM : ir ? ServeOutput::IR : ServeOutput::DOT, opt);
+
+    if (batch) {
+        BatchOptions options;
+        options.jobs = jobs;
+        options.opt = opt;
+        options.assembly = assembly;
+        if (out_path)
+            options.out_dir = out_path;
+        return compile_batch(batch_inputs(path), options, std::cout) > 0;
+    }
+
+    std::filesystem::path file = path;
     TokenList toks;
-    if (!toks.tokenize(file)) {
+    #ifndef NDEBUG
+    // every token is printed up front
+    bool opened = toks.tokenize(file, jobs);
+    #else
+    // lexed while the parser goes, unknown characters are syntax errors, on
+    // more threads the whole file is lexed up front
+    bool opened = jobs > 1 ? toks.tokenize(file, jobs) : toks.stream(file);
+    #endif
+    if (!opened) {
         std::cerr << "Failed to open file: " << file << std::endl;
         return 1;
     }
@@ -24,12 +176,65 @@ int main(int argc, char** argv) {
     #endif
 
     Parser p(std::move(toks));
-    int errors = p.parse();
+    int errors = p.parse(jobs);
+    #ifndef NDEBUG
+    for (auto& ssa : p.get_ir())
+        ssa.print_symbol_table();
+    #endif
     if (errors > 0) {
         std::cerr << "[PARSER] Failed with " << errors << " errors" << std::endl;
         return 1;
     }
 
+    if (opt)
+        p.optimize();
+
+    if (run) {
+        try {
+            VM vm(p.get_ir(), p.get_functions());
+            #ifndef NDEBUG
+            std::cerr << vm << "\n";
+            #endif
+            vm.run(std::cin, std::cout);
+        } catch (const std::runtime_error& e) {
+            std::cout.flush();
+            std::cerr << "[VM] " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (jit) {
+        try {
+            X86 x86(p.get_ir(), p.get_functions());
+            JIT(x86).run();
+        } catch (const std::runtime_error& e) {
+            std::cerr << "[JIT] " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (assembly) {
+        try {
+            X86 x86(p.get_ir(), p.get_functions());
+            if (out_path) {
+                std::ofstream out(out_path);
+                if (!out) {
+                    std::cerr << "Failed to open file: " << out_path << std::endl;
+                    return 1;
+                }
+                x86.emit_asm(out);
+            } else {
+                x86.emit_asm(std::cout);
+            }
+        } catch (const std::runtime_error& e) {
+            std::cerr << "[X86] " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     p.generate_dot();
 
     return 0;
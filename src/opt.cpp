@@ -0,0 +1,86 @@
+#include "opt.h"
+
+Block* ensure_preheader(SSA& ssa, const DominatorTree& dom, const Loop& loop)
+{
+    Block* header = loop.header;
+    Block* pred = header->parent_left;
+    for (auto* p : dom.predecessors(header))
+        if (!loop.contains(p) && p != pred)
+            return nullptr;
+    if (!pred || loop.contains(pred))
+        return nullptr;
+
+    // the head only holds constants
+    auto& instrs = pred->get_instructions();
+    bool bra = !instrs.empty() && instrs.back().type == InstrType::BRA;
+    if (pred->parent_left && !bra && pred->successors() == std::vector<Block*> { header })
+        return pred;
+
+    auto& link = pred->left == header ? pred->left : pred->right;
+    if (link != header)
+        return nullptr;
+
+    Block* pre = ssa.new_block();
+    pre->parent_left = pred;
+    pre->left = link;
+    header->parent_left = pre;
+    link = pre;
+    return pre;
+}
+
+bool is_taken(InstrType type, i64 c)
+{
+    switch (type) {
+    case InstrType::BNE:
+        return c != 0;
+    case InstrType::BEQ:
+        return c == 0;
+    case InstrType::BLE:
+        return c <= 0;
+    case InstrType::BLT:
+        return c < 0;
+    case InstrType::BGE:
+        return c >= 0;
+    case InstrType::BGT:
+        return c > 0;
+    default:
+        break;
+    }
+    throw std::runtime_error("not a branch");
+}
+
+u64 get_const(SSA& ssa, i64 val)
+{
+    Block* head = ssa.get_head();
+    for (auto& instr : head->get_instructions())
+        if (instr.type == InstrType::CONST && instr.literal() == val)
+            return instr.pos;
+
+    Instr instr = {};
+    instr.pos = ssa.next_pos();
+    instr.set_literal(val);
+    return head->add_back(std::move(instr)).pos;
+}
+
+static void optimize(SSA& ssa)
+{
+    propagate_constants(ssa);
+    number_values(ssa);
+    eliminate_dead_code(ssa);
+    hoist_loop_invariants(ssa);
+    reduce_induction_variables(ssa);
+    number_values(ssa);
+    eliminate_dead_code(ssa);
+}
+
+void optimize(std::deque<SSA>& ir, const FunctionMap& functions)
+{
+    // callees are measured and copied after their own optimization
+    eliminate_tail_calls(ir, functions);
+    for (auto& ssa : ir)
+        optimize(ssa);
+    if (!inline_functions(ir, functions))
+        return;
+    for (auto& ssa : ir)
+        optimize(ssa);
+}
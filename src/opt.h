@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ssa.h"
+
+// Optimization passes over the ssa of one function. They keep the block edges
+// and the phi operand sides (x from parent_left, y from parent_right or the
+// back edge) intact and return true if they changed the ir.
+
+// sparse conditional constant propagation, replaces values that are constant on
+// every executable path, folds decided branches and drops unreachable blocks
+bool propagate_constants(SSA& ssa);
+
+// global value numbering over the dominator tree, removes computations and
+// phis equal to one that dominates them
+bool number_values(SSA& ssa);
+
+// moves loop invariant arithmetic into a preheader in front of the loop, division
+// only where moving it can not introduce a trap
+bool hoist_loop_invariants(SSA& ssa);
+
+// strength reduces multiplications and exact divisions of induction variables
+// to additive recurrences and moves the loop test onto them
+bool reduce_induction_variables(SSA& ssa);
+
+// removes instructions whose values never reach a side effect or branch
+bool eliminate_dead_code(SSA& ssa);
+
+// copies small non recursive functions with a single return into their callers,
+// the arguments replace the parameters and the return value the call
+bool inline_functions(std::deque<SSA>& ir, const FunctionMap& functions);
+
+// turns self calls in tail position, also behind an add or multiply with a
+// value computed before the call, into a loop over the parameters
+bool eliminate_tail_calls(std::deque<SSA>& ir, const FunctionMap& functions);
+
+// helpers for the passes
+
+// block in front of the loop header that only falls into it, parent_left of the
+// header if it can be used or a new block on that edge, nullptr if the loop has
+// other entries. Callers invalidate the cfg after adding to it.
+Block* ensure_preheader(SSA& ssa, const DominatorTree& dom, const Loop& loop);
+
+// true if a branch of the type on the cmp result c (-1, 0 or 1) is taken
+bool is_taken(InstrType type, i64 c);
+
+// constant in the head block, added if it does not exist yet
+u64 get_const(SSA& ssa, i64 val);
+
+// runs the pass pipeline over every function of the program
+void optimize(std::deque<SSA>& ir, const FunctionMap& functions);
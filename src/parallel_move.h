@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Sequentializes a parallel copy (dst, src) into moves, a destination is only
+// overwritten after every move reading it has been emitted. Cycles are broken
+// by moving one destination into tmp. Loc needs operator==.
+template <typename Loc, typename Emit>
+void emit_parallel_moves(std::vector<std::pair<Loc, Loc>> moves, const Loc& tmp, Emit emit)
+{
+    moves.erase(std::remove_if(moves.begin(), moves.end(), [](auto& m) { return m.first == m.second; }), moves.end());
+    while (!moves.empty()) {
+        auto ready = std::find_if(moves.begin(), moves.end(), [&](auto& m) {
+            return std::none_of(moves.begin(), moves.end(), [&](auto& o) { return o.second == m.first; });
+        });
+        if (ready == moves.end()) {
+            // only cycles left, free the first destination through tmp
+            Loc dst = moves.front().first;
+            emit(tmp, dst);
+            for (auto& m : moves)
+                if (m.second == dst)
+                    m.second = tmp;
+            continue;
+        }
+        emit(ready->first, ready->second);
+        moves.erase(ready);
+    }
+}
@@ -1,23 +1,23 @@
 #include "parser.h"
+#include "pool.h"
 
-#define SYN_ERROR(...)                            \
-    do {                                          \
-        this->error++;                            \
-        LOG_ERROR("[SYNTAX ERROR] " __VA_ARGS__); \
-    } while (0)
+#define SYN_ERROR(message) syntax_error(message)
+#define SYN_EXPECTED(type_str) expected(type_str)
 
-#define SYN_EXPECTED(type_str)                        \
-    do {                                              \
-        SYN_ERROR("Expected %s, but got ", type_str); \
-        PRTOKLN(*toks.get());                         \
-    } while (0)
+Parser::Parser(TokenList&& toks, std::pmr::memory_resource* memory)
+    : toks(std::move(toks))
+    , memory(memory)
+{
+    ssa = &add_ssa();
+}
 
-Parser::Parser(TokenList&& toks)
+Parser::Parser(const Parser& parent, SSA& ssa, u64 index, TokenList&& toks)
     : toks(std::move(toks))
-    , ssa_stack(1)
+    , memory(parent.memory)
+    , ssa(&ssa)
+    , parent(&parent)
+    , declared(index + 1)
 {
-    assert(ssa_stack.size() == 1);
-    ssa = &ssa_stack.back();
 }
 
 // NOTE:
@@ -27,8 +27,45 @@ Parser::Parser(TokenList&& toks)
 // {} indicates repetition zero or more times
 // () indicates precedence grouping
 
+// Errors the parser can not go on from are thrown as std::runtime_error, they
+// end the parse and count as one more error.
+int Parser::parse(unsigned jobs)
+{
+    try {
+        program(jobs);
+    } catch (const std::runtime_error& e) {
+        fatal_error(e);
+    }
+    return error;
+}
+
+void Parser::syntax_error(std::string message)
+{
+    error++;
+    LOG_ERROR("[SYNTAX ERROR] %s\n", message.c_str());
+    errors.push_back(std::move(message));
+}
+
+void Parser::expected(const char* type_str)
+{
+    std::ostringstream os;
+    os << "Expected " << type_str << ", but got ";
+    if (toks.get())
+        __PRTOK(os, toks, *toks.get());
+    else
+        os << "EOF";
+    syntax_error(os.str());
+}
+
+void Parser::fatal_error(const std::runtime_error& e)
+{
+    error++;
+    LOG_ERROR("[ERROR] %s\n", e.what());
+    errors.emplace_back(e.what());
+}
+
 // “main” [ varDecl ] { funcDecl } “{” statSequence “}” “.”
-int Parser::parse()
+void Parser::program(unsigned jobs)
 {
     // "main"
     if (toks.get_type() != TokenType::MAIN)
@@ -40,6 +77,8 @@ int Parser::parse()
     if (toks.get_type() == TokenType::VAR)
         varDecl();
 
+    if (jobs > 1 && !toks.is_streaming())
+        funcDecls(jobs);
     while (toks.get_type() == TokenType::VOID || toks.get_type() == TokenType::FUNC)
         funcDecl();
 
@@ -65,10 +104,8 @@ int Parser::parse()
         toks.eat();
 
     if (toks.remaining() != 0) {
-        SYN_ERROR("Expected EOF\n");
+        SYN_ERROR("Expected EOF");
     }
-
-    return error;
 }
 
 // [ varDecl ]
@@ -79,7 +116,7 @@ void Parser::varDecl()
 
     SymbolTableType symbols;
     while (toks.get_type() == TokenType::ID) {
-        symbols[*toks.get()->val()] = { toks.get()->id(), std::nullopt };
+        symbols[*toks.val()] = { std::string(toks.id()), std::nullopt };
         toks.eat(); // eat id
 
         TokenType typ = toks.get_type();
@@ -101,6 +138,117 @@ void Parser::varDecl()
 
 // funcDecl = [ “void” ] “function” ident formalParam “;” funcBody “;” .
 void Parser::funcDecl()
+{
+    auto isVoid = funcHeader();
+    if (!isVoid)
+        return;
+    funcBody();
+    if (!funcEnd(*isVoid))
+        return;
+
+    // swap back to main ssa
+    ssa = &ssa_stack[0];
+}
+
+// Token ranges of the bodies of the functions declared from the current token
+// on, from behind the “;” of the header to behind the “;” closing the body.
+// Bodies are found by matching braces. Empty unless every declaration has the
+// shape funcHeader() accepts and a name of its own.
+std::vector<std::pair<size_t, size_t>> Parser::scanFuncDecls() const
+{
+    size_t i = toks.position(), n = toks.size();
+    const auto type = [&](size_t at) { return at < n ? toks.at(at).type() : TokenType::UNKNOWN; };
+
+    std::vector<std::pair<size_t, size_t>> bodies;
+    std::unordered_set<u64> names;
+    while (type(i) == TokenType::VOID || type(i) == TokenType::FUNC) {
+        if (type(i) == TokenType::VOID)
+            i++;
+        if (type(i++) != TokenType::FUNC || type(i) != TokenType::ID || !names.insert(*toks.val(toks.at(i))).second)
+            return {};
+        if (type(++i) != TokenType::LPAREN)
+            return {};
+        // same as the params of funcHeader(), a trailing comma passes
+        for (i++; type(i) == TokenType::ID && type(i + 1) == TokenType::COMMA;)
+            i += 2;
+        if (type(i) == TokenType::ID)
+            i++;
+        if (type(i++) != TokenType::RPAREN || type(i++) != TokenType::SEMI)
+            return {};
+
+        size_t begin = i;
+        while (i < n && type(i) != TokenType::LBRACE && type(i) != TokenType::RBRACE)
+            i++;
+        if (type(i) != TokenType::LBRACE)
+            return {};
+        size_t depth = 0;
+        do {
+            depth += type(i) == TokenType::LBRACE;
+            depth -= type(i) == TokenType::RBRACE;
+            i++;
+        } while (depth && i < n);
+        if (depth || type(i++) != TokenType::SEMI)
+            return {};
+        bodies.emplace_back(begin, i);
+    }
+    return bodies;
+}
+
+// Every header is read in order first, the bodies are skipped and parsed after
+// on the pool, each by a parser of its own into the ssa of its function. The
+// map has every function by then, a body only calls those declared before it
+// and itself as it would in one pass. Anything scanFuncDecls() turns down is
+// left to funcDecl().
+void Parser::funcDecls(unsigned jobs)
+{
+    auto bodies = scanFuncDecls();
+    if (bodies.size() < 2)
+        return;
+
+    std::vector<std::pair<u64, bool>> functions; // index and void
+    for (auto [begin, end] : bodies) {
+        auto isVoid = funcHeader();
+        assert(isVoid && toks.position() == begin);
+        functions.emplace_back(ssa_stack.size() - 1, *isVoid);
+        toks.seek(end);
+    }
+    ssa = &ssa_stack[0];
+
+    // the errors of every body, merged in order after, running out of memory
+    // is thrown on once all of them are done
+    std::vector<std::vector<std::string>> body_errors(bodies.size());
+    std::vector<std::exception_ptr> out_of_memory(bodies.size());
+    ThreadPool pool(jobs);
+    for (size_t i = 0; i < bodies.size(); i++) {
+        pool.submit([&, i]() {
+            try {
+                auto [index, isVoid] = functions[i];
+                Parser body(*this, ssa_stack[index], index, toks.slice(bodies[i].first, bodies[i].second));
+                try {
+                    body.funcBody();
+                    body.funcEnd(isVoid);
+                } catch (const std::runtime_error& e) {
+                    body.fatal_error(e);
+                }
+                body_errors[i] = std::move(body.errors);
+            } catch (const std::bad_alloc&) {
+                out_of_memory[i] = std::current_exception();
+            }
+        });
+    }
+    pool.wait();
+    for (auto& e : out_of_memory)
+        if (e)
+            std::rethrow_exception(e);
+    for (auto& messages : body_errors) {
+        error += messages.size();
+        errors.insert(errors.end(), std::make_move_iterator(messages.begin()), std::make_move_iterator(messages.end()));
+    }
+}
+
+// [ “void” ] “function” ident formalParam “;”, declares the function and swaps
+// to its ssa, returns whether it is void or nothing on a syntax error
+std::optional<bool> Parser::funcHeader()
 {
     bool isVoid = false;
     if (toks.get_type() == TokenType::VOID) {
@@ -110,23 +258,25 @@ void Parser::funcDecl()
 
     if (toks.get_type() != TokenType::FUNC) {
         SYN_EXPECTED("FUNC");
-        return;
+        return std::nullopt;
     }
     toks.eat(); // eat func
 
     if (toks.get_type() != TokenType::ID) {
         SYN_EXPECTED("ID");
-        return;
+        return std::nullopt;
     }
 
     auto& s = add_ssa(); // create function ssa
     s.add_instr(InstrType::NONE); // add temp instr
 
-    assert(toks.get()->val() != std::nullopt);
-    s.name = toks.get()->id();
-    functionMap[*toks.get()->val()].pos = s.get_first_instr();
-    functionMap[*toks.get()->val()].isVoid = isVoid;
-    auto& paramCount = functionMap[*toks.get()->val()].paramCount;
+    assert(toks.val() != std::nullopt);
+    s.name = toks.id();
+    // instruction numbers are per function, calls name the function by its index
+    functionMap[*toks.val()].pos = ssa_stack.size() - 1;
+    functionMap[*toks.val()].isVoid = isVoid;
+    functionMap[*toks.val()].index = ssa_stack.size() - 1;
+    auto& paramCount = functionMap[*toks.val()].paramCount;
     paramCount = 0;
 
     // swap to function ssa
@@ -138,7 +288,7 @@ void Parser::funcDecl()
     // formalParam = “(“ [ident { “,” ident }] “)”
     if (toks.get_type() != TokenType::LPAREN) {
         SYN_EXPECTED("LPAREN");
-        return;
+        return std::nullopt;
     }
     toks.eat(); // lparen
 
@@ -148,7 +298,7 @@ void Parser::funcDecl()
         ssa->add_stack(paramCount + 1);
         ssa->add_instr(InstrType::GETP);
 
-        symbols[*toks.get()->val()] = { toks.get()->id(), ssa->get_last_pos() };
+        symbols[*toks.val()] = { std::string(toks.id()), ssa->get_last_pos() };
         paramCount++;
 
         toks.eat(); // eat id
@@ -160,21 +310,26 @@ void Parser::funcDecl()
 
     if (toks.get_type() != TokenType::RPAREN) {
         SYN_EXPECTED("RPAREN");
-        return;
+        return std::nullopt;
     }
     toks.eat(); // eat rparen
 
     if (toks.get_type() != TokenType::SEMI) {
         SYN_EXPECTED("SEMI");
-        return;
+        return std::nullopt;
     }
     toks.eat(); // eat semi
 
-    funcBody();
+    return isVoid;
+}
 
+// the “;” behind the body, adds the return a function without one falls
+// off the end to
+bool Parser::funcEnd(bool isVoid)
+{
     if (toks.get_type() != TokenType::SEMI) {
         SYN_EXPECTED("SEMI");
-        return;
+        return false;
     }
     toks.eat();
 
@@ -184,9 +339,7 @@ void Parser::funcDecl()
         ssa->add_stack(-1);
         ssa->add_instr(InstrType::RET);
     }
-
-    // swap back to main ssa
-    ssa = &ssa_stack[0];
+    return true;
 }
 
 // funcBody = [ varDecl ] “{” [ statSequence ] “}”
@@ -234,10 +387,8 @@ bool Parser::statement()
         assignment();
         break;
     case TokenType::CALL:
-        if (!funcCall()) {
-            ERROR("Expected void function\n");
-            exit(1);
-        }
+        if (!funcCall())
+            throw std::runtime_error("Expected void function");
         ssa->clear_stack();
         break;
     case TokenType::IF:
@@ -270,7 +421,7 @@ void Parser::assignment()
         SYN_EXPECTED("ID");
         return;
     }
-    auto tok = toks.get();
+    Token tok = *toks.get();
     toks.eat();
 
     // assign
@@ -282,7 +433,7 @@ void Parser::assignment()
 
     expression();
 
-    ssa->set_symbol(tok);
+    ssa->set_symbol(*toks.val(tok), toks.id(tok));
 
     // add placeholder if current is empty
     if (ssa->get_current_block()->empty())
@@ -297,7 +448,7 @@ bool Parser::funcCall()
     if (toks.get_type() != TokenType::ID) {
         SYN_EXPECTED("ID");
     }
-    auto val = toks.get();
+    Token val = *toks.get();
     toks.eat(); // ID
 
     std::vector<u64> args;
@@ -320,13 +471,13 @@ bool Parser::funcCall()
         toks.eat(); // RPAREN
     }
 
-    // USER DEFINED FUNCTION
-    if (functionMap.find(*val->val()) != functionMap.end()) {
-        auto& [jmp_pos, paramCount, isVoid] = functionMap.at(*val->val());
-        if (paramCount != args.size()) {
-            SYN_ERROR("Expected %llu arguments but got %zu\n", paramCount, args.size());
-            exit(1);
-        }
+    // USER DEFINED FUNCTION, see funcDecls() for the index
+    const auto& functions = parent ? parent->functionMap : functionMap;
+    auto function = functions.find(*toks.val(val));
+    if (function != functions.end() && function->second.index < declared) {
+        auto& [jmp_pos, paramCount, isVoid, _] = function->second;
+        if (paramCount != args.size())
+            throw std::runtime_error("Expected " + std::to_string(paramCount) + " arguments but got " + std::to_string(args.size()));
 
         // set params
         u64 arg_num = 0;
@@ -344,13 +495,13 @@ bool Parser::funcCall()
         if (!isVoid)
             ssa->add_stack(ssa->get_last_pos());
 
-        INFO("Function (%s) is %s\n", val->id().c_str(), (isVoid ? "void" : "non-void"));
+        INFO("Function (%s) is %s\n", std::string(toks.id(val)).c_str(), (isVoid ? "void" : "non-void"));
         return isVoid;
     } else { // inbuilt function
         for (auto it = args.rbegin(); it != args.rend(); it++) {
             ssa->add_stack(*it);
         }
-        return ssa->resolve_symbol(val);
+        return ssa->resolve_symbol(*toks.val(val), toks.id(val));
     }
 }
 
@@ -358,7 +509,6 @@ bool Parser::funcCall()
 void Parser::ifStatement()
 {
     toks.eat(); // IF
-    auto dominator = ssa->get_current_block();
 
     relation();
 
@@ -366,15 +516,11 @@ void Parser::ifStatement()
     ssa->reverse_block();
     auto right = ssa->add_block(false);
     JoinNodeType join = {};
-    join.node = std::make_shared<Block>();
+    join.node = ssa->new_block();
     join.isLeft = std::nullopt;
     auto old_symbols = ssa->add_symbols_to_block(join);
     ssa->join_stack.emplace_back(std::move(join));
 
-    left->dominator = dominator;
-    right->dominator = dominator;
-    ssa->join_stack.back().node->dominator = dominator;
-
     auto& [join_block, isBranchLeft, idToPhi, _] = ssa->join_stack.back();
     assert(left->parent_left == right->parent_left);
     auto parent = left->parent_left;
@@ -389,7 +535,9 @@ void Parser::ifStatement()
     isBranchLeft = true;
 
     INFO("[%s] entering left statSequence\n", __func__);
+    ssa->push_scope();
     statSequence();
+    ssa->pop_scope();
     INFO("[%s] exiting left statSequence\n", __func__);
     left = ssa->get_current_block();
 
@@ -401,7 +549,9 @@ void Parser::ifStatement()
         toks.eat(); // else
         ssa->restore_symbol_state(old_symbols);
         INFO("[%s] entering right statSequence\n", __func__);
+        ssa->push_scope();
         statSequence();
+        ssa->pop_scope();
         INFO("[%s] exiting right statSequence\n", __func__);
         right = ssa->get_current_block();
     } else {
@@ -449,7 +599,8 @@ void Parser::whileStatement()
     JoinNodeType join = {};
     join.isLeft = false;
 
-    if (ssa->get_current_block()->size() == 1 && ssa->get_current_block()->back().type == InstrType::NONE) {
+    // NOTE: an if join already has two parents, reusing it would give the loop phis three
+    if (ssa->get_current_block()->size() == 1 && ssa->get_current_block()->back().type == InstrType::NONE && !ssa->get_current_block()->parent_right) {
         join.node = ssa->get_current_block();
     } else {
         join.node = ssa->add_block(true);
@@ -467,16 +618,16 @@ void Parser::whileStatement()
     auto& join_block = ssa->join_stack.back().node;
     auto loop = ssa->add_block(true);
 
-    loop->dominator = ssa->join_stack.back().node;
-    exit_block->dominator = ssa->join_stack.back().node;
-
     if (toks.get_type() != TokenType::DO) {
         SYN_EXPECTED("DO");
         return;
     }
     toks.eat();
 
+    // the body may never run, its expressions are gone once the loop is committed
+    ssa->push_scope();
     statSequence();
+    ssa->pop_scope();
     auto end_block = ssa->get_current_block();
     end_block->entry = join_block;
 
@@ -575,11 +726,11 @@ void Parser::factor()
 {
     switch (toks.get_type()) {
     case TokenType::ID:
-        ssa->resolve_symbol(toks.get());
+        ssa->resolve_symbol(*toks.val(), toks.id());
         toks.eat();
         break;
     case TokenType::NUM:
-        ssa->add_const(*toks.get()->val());
+        ssa->add_const(*toks.val());
         toks.eat();
         break;
     case TokenType::LPAREN: {
@@ -591,10 +742,8 @@ void Parser::factor()
             toks.eat();
     } break;
     case TokenType::CALL:
-        if (funcCall()) {
-            ERROR("Expected non-void function\n");
-            exit(1);
-        }
+        if (funcCall())
+            throw std::runtime_error("Expected non-void function");
         break;
     default:
         break;
@@ -1,39 +1,63 @@
 #pragma once
 
+#include "opt.h"
 #include "ssa.h"
 #include "token.h"
 
 class Parser {
 public:
-    Parser(TokenList&& toks);
-    int parse();
+    // the ssa of every function is allocated from memory
+    Parser(TokenList&& toks, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+    // With more than one job the function bodies of a list that is not
+    // streaming are parsed on a pool of that many threads, the ir is the same.
+    int parse(unsigned jobs = 1);
 
-    inline const std::deque<SSA>& get_ir() { return ssa_stack; }
-    inline void generate_dot() const
+    // one message for every error counted by parse()
+    inline const std::vector<std::string>& get_errors() const { return errors; }
+    inline const std::deque<SSA>& get_ir() const { return ssa_stack; }
+    inline const FunctionMap& get_functions() const { return functionMap; }
+    inline void optimize() { ::optimize(ssa_stack, functionMap); }
+    inline void generate_dot(std::ostream& os = std::cout) const
     {
         for (auto& e : ssa_stack) {
-            e.generate_dot();
-            std::cout << std::endl;
+            e.generate_dot(os);
+            os << std::endl;
         }
     }
 
 private:
     TokenList toks;
     int error = 0;
+    std::vector<std::string> errors;
+    std::pmr::memory_resource* memory;
     std::deque<SSA> ssa_stack;
     SSA* ssa;
 
     FunctionMap functionMap;
 
+    // parsers of single function bodies read the functions of their parent,
+    // those with an index below declared
+    Parser(const Parser& parent, SSA& ssa, u64 index, TokenList&& toks);
+    const Parser* parent = nullptr;
+    u64 declared = UINT64_MAX;
+
     inline SSA& add_ssa()
     {
-        ssa_stack.resize(ssa_stack.size() + 1);
-        return ssa_stack.back();
+        return ssa_stack.emplace_back(memory);
     }
 
+    void syntax_error(std::string message);
+    void expected(const char* type_str);
+    void fatal_error(const std::runtime_error& e);
+
+    void program(unsigned jobs);
     void varDecl();
     void funcDecl();
+    std::optional<bool> funcHeader();
     void funcBody();
+    bool funcEnd(bool isVoid);
+    std::vector<std::pair<size_t, size_t>> scanFuncDecls() const;
+    void funcDecls(unsigned jobs);
 
     void statSequence();
     bool statement();
@@ -0,0 +1,95 @@
+#include "pool.h"
+
+// queue of the pool thread running this, 0 on threads outside of any pool
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local size_t current_queue = 0;
+
+ThreadPool::ThreadPool(unsigned jobs)
+{
+    jobs = std::max(jobs, 1u);
+    for (unsigned i = 0; i < jobs; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 1; i < jobs; i++)
+        threads.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::lock_guard lock(sleep);
+        stop = true;
+    }
+    changed.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    auto& q = *queues[current_pool == this ? current_queue : 0];
+    pending++;
+    {
+        std::lock_guard lock(q.lock);
+        q.tasks.push_back(std::move(task));
+    }
+    {
+        // under the lock so a thread about to sleep sees it
+        std::lock_guard lock(sleep);
+        queued++;
+    }
+    changed.notify_all();
+}
+
+bool ThreadPool::run_one(size_t self)
+{
+    std::function<void()> task;
+    for (size_t i = 0; i < queues.size() && !task; i++) {
+        auto& q = *queues[(self + i) % queues.size()];
+        std::lock_guard lock(q.lock);
+        if (q.tasks.empty())
+            continue;
+        if (i == 0) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        } else {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+    }
+    if (!task)
+        return false;
+
+    queued--;
+    task();
+    if (--pending == 0) {
+        std::lock_guard lock(sleep);
+        changed.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::work(size_t self)
+{
+    current_pool = this;
+    current_queue = self;
+    while (true) {
+        if (run_one(self))
+            continue;
+        std::unique_lock lock(sleep);
+        changed.wait(lock, [&]() { return stop || queued > 0; });
+        if (stop)
+            return;
+    }
+}
+
+void ThreadPool::wait()
+{
+    size_t self = current_pool == this ? current_queue : 0;
+    while (pending > 0) {
+        if (run_one(self))
+            continue;
+        std::unique_lock lock(sleep);
+        changed.wait(lock, [&]() { return pending == 0 || queued > 0; });
+    }
+}
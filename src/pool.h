@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Work stealing thread pool. Every thread has a queue of its own, it takes the
+// newest task from the back of it and steals the oldest from the front of the
+// others once it is empty. The thread that waits runs tasks as well, a pool of
+// one job runs everything in wait(). Tasks must not throw or wait on their pool.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned jobs);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    // from a task it goes on the queue of its thread, otherwise on the queue of
+    // the waiting thread
+    void submit(std::function<void()> task);
+    // returns once every task submitted so far, and all they submit, is done
+    void wait();
+
+    inline unsigned jobs() const { return (unsigned)queues.size(); }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues; // the first one for outside threads
+    std::vector<std::thread> threads;
+
+    std::atomic<size_t> queued = 0; // submitted but not started
+    std::atomic<size_t> pending = 0; // submitted but not done
+    std::mutex sleep;
+    std::condition_variable changed;
+    bool stop = false;
+
+    bool run_one(size_t self);
+    void work(size_t self);
+};
@@ -0,0 +1,490 @@
+#include "regalloc.h"
+
+#include <algorithm>
+#include <queue>
+
+// rax is scratch for the lowering and idiv, r11 for wide immediates, parallel moves and jit calls
+static const Reg caller_saved[] = { Reg::RSI, Reg::RDI, Reg::R8, Reg::R9, Reg::R10, Reg::RCX, Reg::RDX };
+static const Reg callee_saved_regs[] = { Reg::RBX, Reg::R12, Reg::R13, Reg::R14, Reg::R15 };
+static const Reg allocatable[] = {
+    Reg::RSI, Reg::RDI, Reg::R8, Reg::R9, Reg::R10, Reg::RCX, Reg::RDX,
+    Reg::RBX, Reg::R12, Reg::R13, Reg::R14, Reg::R15
+};
+
+#define NO_POS UINT32_MAX
+
+bool RegAlloc::Interval::covers(u32 pos) const
+{
+    for (auto& r : ranges)
+        if (pos >= r.from && pos < r.to)
+            return true;
+    return false;
+}
+
+std::optional<u32> RegAlloc::Interval::next_use(u32 pos) const
+{
+    auto it = std::lower_bound(uses.begin(), uses.end(), pos);
+    if (it == uses.end())
+        return std::nullopt;
+    return *it;
+}
+
+std::optional<u32> RegAlloc::Interval::next_intersection(const Interval& other) const
+{
+    auto a = ranges.begin();
+    auto b = other.ranges.begin();
+    while (a != ranges.end() && b != other.ranges.end()) {
+        u32 from = std::max(a->from, b->from);
+        if (from < std::min(a->to, b->to))
+            return from;
+        if (a->to < b->to)
+            a++;
+        else
+            b++;
+    }
+    return std::nullopt;
+}
+
+RegAlloc::RegAlloc(const std::vector<Block*>& order)
+{
+    u32 pos = 4; // 0 is the function entry where the params are defined
+    for (auto* b : order) {
+        auto& info = blocks[b];
+        const auto& instrs = b->get_instructions();
+
+        info.from = pos;
+        block_starts.insert(pos);
+        for (auto& instr : instrs) {
+            numbers[instr.pos] = pos;
+            defs[instr.pos] = &instr;
+            switch (instr.type) {
+            case InstrType::JUMP:
+            case InstrType::READ:
+            case InstrType::WRITE:
+            case InstrType::WRITENL:
+                for (auto r : caller_saved)
+                    clobbers[(u8)r].push_back(pos + 1);
+                break;
+            case InstrType::DIV:
+                // cqo overwrites rdx before idiv reads its operands
+                clobbers[(u8)Reg::RDX].push_back(pos);
+                break;
+            default:
+                break;
+            }
+            pos += 4;
+        }
+        info.end = pos;
+        pos += 4;
+        info.to = pos;
+    }
+
+    // a cmp is folded into the branch of its block unless something else
+    // reads it, a branch further down the dominator tree keeps it a value
+    std::unordered_map<u64, u32> readers;
+    for (auto* b : order)
+        for (auto& instr : b->get_instructions()) {
+            if (instr.isValueX() && instr.x)
+                readers[*instr.x]++;
+            if (instr.isValueY() && instr.y)
+                readers[*instr.y]++;
+        }
+    for (auto* b : order) {
+        const auto& instrs = b->get_instructions();
+        if (!instrs.empty() && isBranch(instrs.back().type) && instrs.back().x && readers[*instrs.back().x] == 1)
+            for (auto& instr : instrs)
+                if (instr.type == InstrType::CMP && instr.pos == *instrs.back().x)
+                    fused.insert(instr.pos);
+    }
+
+    build_intervals(order);
+    linear_scan();
+    resolve_splits();
+
+    for (auto r : callee_saved_regs) {
+        bool used = std::any_of(storage.begin(), storage.end(), [&](const Interval& it) { return it.reg == r; });
+        if (used)
+            callee_saved.push_back(r);
+    }
+}
+
+void RegAlloc::build_intervals(const std::vector<Block*>& order)
+{
+    // values read by the instruction at i and where, setp arguments are read
+    // by the call and the operands of a fused cmp by its branch
+    const auto reads = [&](const InstrList& instrs, size_t i) {
+        std::vector<std::pair<u64, u32>> result;
+        const auto& instr = instrs[i];
+        u32 at = numbers[instr.pos];
+        if (instr.type == InstrType::SETP || fused.count(instr.pos)) {
+            for (size_t j = i + 1; j < instrs.size(); j++) {
+                if (instrs[j].type == InstrType::JUMP || isBranch(instrs[j].type)) {
+                    at = numbers[instrs[j].pos];
+                    break;
+                }
+            }
+        }
+        if (instr.isValueX() && is_tracked(instr.x))
+            result.emplace_back(*instr.x, at);
+        if (instr.isValueY() && is_tracked(instr.y))
+            result.emplace_back(*instr.y, at);
+        return result;
+    };
+
+    // phi operands flowing out of b, read at its end slot
+    const auto phi_reads = [&](Block* b) {
+        std::vector<u64> result;
+        for (auto* s : b->successors()) {
+            bool y = s->is_phi_y(b);
+            for (auto& instr : s->get_instructions()) {
+                auto v = y ? instr.y : instr.x;
+                if (instr.type == InstrType::PHI && is_tracked(v))
+                    result.push_back(*v);
+            }
+        }
+        return result;
+    };
+
+    // liveness to a fixed point, live_in excludes the phis of the block
+    std::unordered_map<Block*, std::set<u64>> live_out, kills, gens;
+    for (auto* b : order) {
+        const auto& instrs = b->get_instructions();
+        for (size_t i = 0; i < instrs.size(); i++) {
+            if (is_tracked(instrs[i].pos))
+                kills[b].insert(instrs[i].pos);
+            if (instrs[i].type != InstrType::PHI)
+                for (auto [v, _] : reads(instrs, i))
+                    gens[b].insert(v);
+        }
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            Block* b = *it;
+            std::set<u64> out;
+            for (auto* s : b->successors())
+                out.insert(blocks.at(s).live_in.begin(), blocks.at(s).live_in.end());
+            for (auto v : phi_reads(b))
+                out.insert(v);
+
+            std::set<u64> in;
+            for (auto v : out)
+                if (!kills[b].count(v))
+                    in.insert(v);
+            for (auto v : gens[b])
+                if (!kills[b].count(v))
+                    in.insert(v);
+
+            if (in != blocks[b].live_in) {
+                blocks[b].live_in = std::move(in);
+                changed = true;
+            }
+            live_out[b] = std::move(out);
+        }
+    }
+
+    const auto interval = [&](u64 v) -> Interval& {
+        auto& p = pieces[v];
+        if (p.empty()) {
+            p.push_back(&storage.emplace_back());
+            p.back()->value = v;
+        }
+        return *p.front();
+    };
+
+    // blocks are walked backwards so ranges are only ever prepended or merged into the first one
+    const auto add_range = [&](u64 v, u32 from, u32 to) {
+        auto& ranges = interval(v).ranges;
+        if (!ranges.empty() && ranges.front().from <= to) {
+            ranges.front().from = std::min(ranges.front().from, from);
+            ranges.front().to = std::max(ranges.front().to, to);
+        } else {
+            ranges.insert(ranges.begin(), { from, to });
+        }
+    };
+
+    const auto set_from = [&](u64 v, u32 from) {
+        auto& ranges = interval(v).ranges;
+        if (ranges.empty())
+            ranges.push_back({ from, from + 1 }); // never read
+        else
+            ranges.front().from = from;
+    };
+
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        Block* b = *it;
+        const auto& info = blocks[b];
+        const auto& instrs = b->get_instructions();
+
+        for (auto v : live_out[b])
+            add_range(v, info.from, info.to);
+        for (auto v : phi_reads(b))
+            interval(v).uses.push_back(info.end);
+
+        for (size_t i = instrs.size(); i-- > 0;) {
+            const auto& instr = instrs[i];
+            if (instr.type == InstrType::PHI)
+                continue;
+            if (is_tracked(instr.pos))
+                set_from(instr.pos, instr.type == InstrType::GETP ? 0 : numbers[instr.pos] + 2);
+            for (auto [v, at] : reads(instrs, i)) {
+                add_range(v, info.from, at + 1);
+                interval(v).uses.push_back(at);
+            }
+        }
+        // phis are defined on block entry together, like the edge moves writing them
+        for (auto& instr : instrs)
+            if (instr.type == InstrType::PHI && is_tracked(instr.pos))
+                set_from(instr.pos, info.from);
+    }
+
+    for (auto& it : storage)
+        std::sort(it.uses.begin(), it.uses.end());
+}
+
+RegAlloc::Interval* RegAlloc::split(Interval* it, u32 pos)
+{
+    assert(pos > it->start() && pos < it->end());
+    Interval* child = &storage.emplace_back();
+    child->value = it->value;
+
+    std::vector<Range> keep;
+    for (auto& r : it->ranges) {
+        if (r.to <= pos) {
+            keep.push_back(r);
+        } else if (r.from >= pos) {
+            child->ranges.push_back(r);
+        } else {
+            keep.push_back({ r.from, pos });
+            child->ranges.push_back({ pos, r.to });
+        }
+    }
+    it->ranges = std::move(keep);
+
+    auto use = std::lower_bound(it->uses.begin(), it->uses.end(), pos);
+    child->uses.assign(use, it->uses.end());
+    it->uses.erase(use, it->uses.end());
+
+    auto& p = pieces[it->value];
+    p.insert(std::upper_bound(p.begin(), p.end(), child, [](Interval* a, Interval* b) { return a->start() < b->start(); }), child);
+    return child;
+}
+
+Operand RegAlloc::spill_location(u64 value)
+{
+    auto [it, _] = slots.try_emplace(value, spill_slots);
+    if (it->second == spill_slots)
+        spill_slots++;
+    return Operand::mem(Reg::RBP, -8 * (i32)(it->second + 1));
+}
+
+Operand RegAlloc::piece_location(const Interval& it) const
+{
+    if (it.reg)
+        return Operand::r(*it.reg);
+    return Operand::mem(Reg::RBP, -8 * (i32)(slots.at(it.value) + 1));
+}
+
+void RegAlloc::linear_scan()
+{
+    const auto later = [](Interval* a, Interval* b) { return a->start() > b->start(); };
+    std::priority_queue<Interval*, std::vector<Interval*>, decltype(later)> unhandled(later);
+    for (auto& [_, p] : pieces)
+        unhandled.push(p.front());
+
+    std::vector<Interval*> active, inactive;
+
+    // first clobber of r covered by the interval
+    const auto first_clobber = [&](const Interval* it, Reg r) -> std::optional<u32> {
+        const auto& c = clobbers[(u8)r];
+        for (auto at = std::lower_bound(c.begin(), c.end(), it->start()); at != c.end() && *at < it->end(); ++at)
+            if (it->covers(*at))
+                return *at;
+        return std::nullopt;
+    };
+
+    // moves the rest of it from pos on to the stack until its next use
+    const auto spill = [&](Interval* it, u32 pos) {
+        Interval* rest = pos <= it->start() ? it : split(it, pos);
+        rest->reg.reset();
+        spill_location(rest->value);
+        auto use = rest->next_use(rest->start() + 1);
+        if (use && *use < rest->end())
+            unhandled.push(split(rest, *use));
+    };
+
+    const auto try_allocate_free = [&](Interval* current) {
+        std::array<u32, 16> free_until {};
+        for (auto r : allocatable)
+            free_until[(u8)r] = NO_POS;
+        for (auto* it : active)
+            free_until[(u8)*it->reg] = 0;
+        for (auto* it : inactive)
+            if (auto at = it->next_intersection(*current))
+                free_until[(u8)*it->reg] = std::min(free_until[(u8)*it->reg], *at);
+        for (auto r : caller_saved)
+            if (auto c = first_clobber(current, r))
+                free_until[(u8)r] = std::min(free_until[(u8)r], *c);
+
+        Reg reg = *std::max_element(std::begin(allocatable), std::end(allocatable), [&](Reg a, Reg b) {
+            return free_until[(u8)a] < free_until[(u8)b];
+        });
+        u32 limit = free_until[(u8)reg];
+        if (limit == 0)
+            return false;
+        if (limit >= current->end()) {
+            current->reg = reg;
+            return true;
+        }
+
+        // a register only for the first part, split at an instruction boundary before the conflict
+        u32 at = limit & ~3u;
+        if (at <= current->start())
+            return false;
+        current->reg = reg;
+        unhandled.push(split(current, at));
+        return true;
+    };
+
+    const auto allocate_blocked = [&](Interval* current) {
+        u32 start = current->start();
+        std::array<u32, 16> next_use {}, block_pos {};
+        for (auto r : allocatable)
+            next_use[(u8)r] = block_pos[(u8)r] = NO_POS;
+        for (auto* it : active)
+            next_use[(u8)*it->reg] = std::min(next_use[(u8)*it->reg], it->next_use(start).value_or(NO_POS));
+        for (auto* it : inactive)
+            if (it->next_intersection(*current))
+                next_use[(u8)*it->reg] = std::min(next_use[(u8)*it->reg], it->next_use(start).value_or(NO_POS));
+        for (auto r : caller_saved) {
+            if (auto c = first_clobber(current, r)) {
+                u32 at = (*c & ~3u) > start ? *c & ~3u : 0;
+                block_pos[(u8)r] = std::min(block_pos[(u8)r], at);
+                next_use[(u8)r] = std::min(next_use[(u8)r], at);
+            }
+        }
+
+        Reg reg = *std::max_element(std::begin(allocatable), std::end(allocatable), [&](Reg a, Reg b) {
+            return next_use[(u8)a] < next_use[(u8)b];
+        });
+
+        // every register is read again before current is, current goes to the stack instead
+        auto first = current->next_use(start);
+        if (!first || next_use[(u8)reg] == 0 || next_use[(u8)reg] < *first) {
+            spill(current, start);
+            return;
+        }
+
+        current->reg = reg;
+        if (block_pos[(u8)reg] < current->end())
+            unhandled.push(split(current, block_pos[(u8)reg]));
+
+        // evict the intervals holding reg
+        std::vector<Interval*> keep;
+        for (auto* it : active) {
+            if (it->reg == reg)
+                spill(it, start);
+            else
+                keep.push_back(it);
+        }
+        active = std::move(keep);
+        keep.clear();
+        for (auto* it : inactive) {
+            if (it->reg == reg && it->next_intersection(*current))
+                spill(it, start);
+            else
+                keep.push_back(it);
+        }
+        inactive = std::move(keep);
+    };
+
+    while (!unhandled.empty()) {
+        Interval* current = unhandled.top();
+        unhandled.pop();
+        u32 pos = current->start();
+
+        std::vector<Interval*> still_active, still_inactive;
+        for (auto* it : active) {
+            if (it->end() <= pos)
+                continue;
+            (it->covers(pos) ? still_active : still_inactive).push_back(it);
+        }
+        for (auto* it : inactive) {
+            if (it->end() <= pos)
+                continue;
+            (it->covers(pos) ? still_active : still_inactive).push_back(it);
+        }
+        active = std::move(still_active);
+        inactive = std::move(still_inactive);
+
+        if (!try_allocate_free(current))
+            allocate_blocked(current);
+        if (current->reg)
+            active.push_back(current);
+    }
+}
+
+// a split inside a block needs a move, splits on block boundaries are resolved on the edges.
+// Splits on a result only ever evict to the stack, they are kept apart from the
+// moves before the operands are read as both may move the same value.
+void RegAlloc::resolve_splits()
+{
+    for (auto& [_, p] : pieces) {
+        for (size_t i = 1; i < p.size(); i++) {
+            u32 at = p[i]->start();
+            if (p[i - 1]->end() != at || block_starts.count(at))
+                continue;
+            u32 slot = at % 4 ? (at & ~3u) + 2 : at;
+            split_moves[slot].emplace_back(piece_location(*p[i]), piece_location(*p[i - 1]));
+        }
+    }
+}
+
+Operand RegAlloc::location(std::optional<u64> value, u32 pos) const
+{
+    if (!value)
+        return Operand::imm(0);
+    auto def = defs.find(*value);
+    if (def == defs.end())
+        return Operand::imm(0);
+    if (def->second->type == InstrType::CONST)
+        return Operand::imm(def->second->literal());
+
+    auto p = pieces.find(*value);
+    if (p == pieces.end())
+        return Operand::imm(0);
+    for (auto* it : p->second)
+        if (it->covers(pos))
+            return piece_location(*it);
+
+    // not live at pos, the value is never read from there
+    const Interval* last = p->second.front();
+    for (auto* it : p->second)
+        if (it->start() <= pos)
+            last = it;
+    return piece_location(*last);
+}
+
+std::vector<std::pair<Operand, Operand>> RegAlloc::moves_at(u32 pos) const
+{
+    auto it = split_moves.find(pos);
+    if (it == split_moves.end())
+        return {};
+    return it->second;
+}
+
+std::vector<std::pair<Operand, Operand>> RegAlloc::edge_moves(Block* from, Block* to) const
+{
+    const auto& f = blocks.at(from);
+    const auto& t = blocks.at(to);
+
+    std::vector<std::pair<Operand, Operand>> moves;
+    for (auto v : t.live_in)
+        moves.emplace_back(location(v, t.from), location(v, f.to - 1));
+
+    bool y = to->is_phi_y(from);
+    for (auto& instr : to->get_instructions())
+        if (instr.type == InstrType::PHI)
+            moves.emplace_back(location(instr.pos, t.from), location(y ? instr.y : instr.x, f.end));
+    return moves;
+}
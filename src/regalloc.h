@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <set>
+
+#include "x86.h"
+
+// Linear scan register allocation over the ssa values of one function with
+// interval splitting and spilling (Wimmer & Franz).
+//
+// Instructions are numbered in block order in steps of 4, operands are read at
+// n, calls clobber the caller saved registers at n + 1 and the result is
+// written at n + 2. Every block has an extra end slot where phi operands are
+// read and the edge moves happen. Phis are defined at the start of their block
+// and params at 0 on function entry.
+//
+// Division clobbers rdx already at n, as cqo overwrites it before idiv reads
+// the divisor.
+//
+// Constants never occupy a register, they are rematerialized as immediates.
+class RegAlloc {
+public:
+    RegAlloc(const std::vector<Block*>& order);
+
+    // location of a value at pos, constants and missing values are immediates
+    Operand location(std::optional<u64> value, u32 pos) const;
+
+    inline u32 number(const Instr& instr) const { return numbers.at(instr.pos); }
+    inline u32 block_end(Block* b) const { return blocks.at(b).end; }
+
+    // true if the cmp is only read by the branch ending its block
+    inline bool is_fused(const Instr& cmp) const { return fused.count(cmp.pos); }
+
+    // (dst, src) moves to perform in parallel for splits at pos, the moves for
+    // n and then n + 2 all happen before the instruction at n
+    std::vector<std::pair<Operand, Operand>> moves_at(u32 pos) const;
+
+    // (dst, src) moves for the control flow edge, including the phis of to
+    std::vector<std::pair<Operand, Operand>> edge_moves(Block* from, Block* to) const;
+
+    inline const std::vector<Reg>& get_callee_saved() const { return callee_saved; }
+    inline u32 get_spill_slots() const { return spill_slots; }
+
+private:
+    struct Range {
+        u32 from, to; // [from, to)
+    };
+
+    struct Interval {
+        u64 value;
+        std::vector<Range> ranges;
+        std::vector<u32> uses;
+        std::optional<Reg> reg; // spilled when empty
+
+        inline u32 start() const { return ranges.front().from; }
+        inline u32 end() const { return ranges.back().to; }
+        bool covers(u32 pos) const;
+        std::optional<u32> next_use(u32 pos) const; // first use >= pos
+        std::optional<u32> next_intersection(const Interval& other) const;
+    };
+
+    struct BlockInfo {
+        u32 from, end, to;
+        std::set<u64> live_in; // without the phis of the block
+    };
+
+    std::unordered_map<Block*, BlockInfo> blocks;
+    std::unordered_set<u32> block_starts;
+    std::unordered_map<u64, u32> numbers;
+    std::unordered_map<u64, const Instr*> defs;
+    std::unordered_set<u64> fused;
+    std::array<std::vector<u32>, 16> clobbers; // register -> positions it is overwritten at
+
+    std::deque<Interval> storage;
+    std::map<u64, std::vector<Interval*>> pieces; // value -> split pieces by start
+    std::unordered_map<u64, u32> slots;
+    std::unordered_map<u32, std::vector<std::pair<Operand, Operand>>> split_moves;
+
+    std::vector<Reg> callee_saved;
+    u32 spill_slots = 0;
+
+    inline bool is_tracked(std::optional<u64> value) const
+    {
+        if (!value)
+            return false;
+        auto it = defs.find(*value);
+        return it != defs.end() && it->second->type != InstrType::CONST && !fused.count(*value);
+    }
+
+    void build_intervals(const std::vector<Block*>& order);
+    void linear_scan();
+    void resolve_splits();
+
+    Interval* split(Interval* it, u32 pos);
+    Operand spill_location(u64 value);
+    Operand piece_location(const Interval& it) const;
+};
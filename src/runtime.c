@@ -0,0 +1,66 @@
+// Builtins for the native backends, linked into programs compiled with ty -S
+// and called directly by the jit.
+
+#include "runtime.h"
+
+#include <inttypes.h>
+#include <setjmp.h>
+#include <stdlib.h>
+
+static FILE* ty_in = NULL;
+static FILE* ty_out = NULL;
+
+// set while ty_call runs a program, errors jump back to it instead of exiting
+static jmp_buf* ty_trap = NULL;
+static const char* ty_error = NULL;
+
+void ty_set_io(FILE* in, FILE* out)
+{
+    ty_in = in;
+    ty_out = out;
+}
+
+const char* ty_call(int (*entry)(void))
+{
+    jmp_buf trap;
+    ty_error = NULL;
+    ty_trap = &trap;
+    // the program keeps no state of its own, leaving it halfway is safe
+    if (setjmp(trap) == 0)
+        entry();
+    ty_trap = NULL;
+    return ty_error;
+}
+
+void ty_fail(const char* message)
+{
+    if (ty_trap) {
+        ty_error = message;
+        longjmp(*ty_trap, 1);
+    }
+    fprintf(stderr, "%s\n", message);
+    exit(1);
+}
+
+int64_t ty_read(void)
+{
+    int64_t v;
+    if (fscanf(ty_in ? ty_in : stdin, "%" SCNd64, &v) != 1)
+        ty_fail("failed to read input");
+    return v;
+}
+
+void ty_write(int64_t v)
+{
+    fprintf(ty_out ? ty_out : stdout, "%" PRId64, v);
+}
+
+void ty_writeNL(void)
+{
+    fputc('\n', ty_out ? ty_out : stdout);
+}
+
+void ty_div_zero(void)
+{
+    ty_fail("division by zero");
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int64_t ty_read(void);
+void ty_write(int64_t v);
+void ty_writeNL(void);
+// called by a division in place of dividing by zero
+__attribute__((noreturn)) void ty_div_zero(void);
+
+// redirects the builtins, NULL restores stdin / stdout
+void ty_set_io(FILE* in, FILE* out);
+
+// Runs a program, the message of the error that ended it or NULL. Outside of
+// ty_call an error is printed and exits, as a native program should.
+const char* ty_call(int (*entry)(void));
+__attribute__((noreturn)) void ty_fail(const char* message);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <set>
+
+#include "opt.h"
+
+// values start out unknown and only ever move down to a constant and then to
+// overdefined
+struct Lattice {
+    enum State { TOP, CONST, BOTTOM } state = TOP;
+    i64 val = 0;
+
+    inline bool operator==(const Lattice& other) const
+    {
+        return state == other.state && (state != CONST || val == other.val);
+    }
+};
+
+static const Lattice bottom = { Lattice::BOTTOM, 0 };
+static inline Lattice constant(i64 val) { return { Lattice::CONST, val }; }
+
+static Lattice meet(const Lattice& a, const Lattice& b)
+{
+    if (a.state == Lattice::TOP)
+        return b;
+    if (b.state == Lattice::TOP || a == b)
+        return a;
+    return bottom;
+}
+
+// folds with the semantics of the vm, division by zero is left to fail at run time
+static Lattice fold(InstrType type, i64 a, i64 b)
+{
+    switch (type) {
+    case InstrType::ADD:
+        return constant((i64)((u64)a + (u64)b));
+    case InstrType::SUB:
+        return constant((i64)((u64)a - (u64)b));
+    case InstrType::MUL:
+        return constant((i64)((u64)a * (u64)b));
+    case InstrType::DIV:
+        if (b == 0)
+            return bottom;
+        return constant(b == -1 ? (i64)(0 - (u64)a) : a / b);
+    case InstrType::CMP:
+        return constant((a > b) - (a < b));
+    default:
+        break;
+    }
+    return bottom;
+}
+
+static inline bool is_foldable(InstrType type)
+{
+    switch (type) {
+    case InstrType::ADD:
+    case InstrType::SUB:
+    case InstrType::MUL:
+    case InstrType::DIV:
+    case InstrType::CMP:
+    case InstrType::PHI:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+static inline const Instr* terminator(const Block* b)
+{
+    auto& instrs = b->get_instructions();
+    if (instrs.empty() || !isBranch(instrs.back().type))
+        return nullptr;
+    return &instrs.back();
+}
+
+// Wegman & Zadeck, values are only evaluated in executable blocks and phis only
+// meet the operands of executable edges
+bool propagate_constants(SSA& ssa)
+{
+    auto order = ssa.reverse_post_order();
+
+    std::unordered_map<u64, const Instr*> defs;
+    std::unordered_map<u64, std::vector<std::pair<const Instr*, Block*>>> users;
+    std::unordered_map<Block*, std::vector<Block*>> preds;
+    for (auto* b : order) {
+        for (auto& instr : b->get_instructions()) {
+            defs[instr.pos] = &instr;
+            if (instr.isValueX() && instr.x)
+                users[*instr.x].emplace_back(&instr, b);
+            if (instr.isValueY() && instr.y)
+                users[*instr.y].emplace_back(&instr, b);
+        }
+        for (auto* s : b->successors())
+            preds[s].push_back(b);
+    }
+
+    std::unordered_map<u64, Lattice> values;
+    std::set<std::pair<Block*, Block*>> edges;
+    std::unordered_set<Block*> executable, undecided;
+    std::vector<std::pair<Block*, Block*>> flow = { { nullptr, order.front() } };
+    std::vector<u64> changed_values;
+
+    // missing operands read as 0
+    const auto value_of = [&](std::optional<u64> v) -> Lattice {
+        if (!v)
+            return constant(0);
+        auto def = defs.find(*v);
+        if (def == defs.end())
+            return bottom;
+        if (def->second->type == InstrType::CONST)
+            return constant(def->second->literal());
+        if (!is_foldable(def->second->type))
+            return bottom;
+        auto it = values.find(*v);
+        return it == values.end() ? Lattice {} : it->second;
+    };
+
+    const auto visit = [&](const Instr& instr, Block* b) {
+        if (isBranch(instr.type)) {
+            if (&instr != terminator(b))
+                return;
+            auto c = value_of(instr.x);
+            auto succ = b->successors(); // fall through, taken
+            if (c.state == Lattice::BOTTOM || undecided.count(b)) {
+                flow.emplace_back(b, succ[0]);
+                flow.emplace_back(b, succ[1]);
+            } else if (c.state == Lattice::CONST) {
+                flow.emplace_back(b, succ[is_taken(instr.type, c.val)]);
+            }
+            return;
+        }
+        if (!is_foldable(instr.type))
+            return;
+
+        Lattice val;
+        if (instr.type == InstrType::PHI) {
+            for (auto* p : preds[b])
+                if (edges.count({ p, b }))
+                    val = meet(val, value_of(b->is_phi_y(p) ? instr.y : instr.x));
+        } else {
+            auto x = value_of(instr.x), y = value_of(instr.y);
+            if (x.state == Lattice::BOTTOM || y.state == Lattice::BOTTOM)
+                val = bottom;
+            else if (x.state == Lattice::CONST && y.state == Lattice::CONST)
+                val = fold(instr.type, x.val, y.val);
+        }
+
+        auto& old = values[instr.pos];
+        val = meet(old, val);
+        if (!(old == val)) {
+            old = val;
+            changed_values.push_back(instr.pos);
+        }
+    };
+
+    for (;;) {
+        while (!flow.empty() || !changed_values.empty()) {
+            if (!flow.empty()) {
+                auto [from, to] = flow.back();
+                flow.pop_back();
+                if (from && !edges.insert({ from, to }).second)
+                    continue;
+                bool first = executable.insert(to).second;
+                for (auto& instr : to->get_instructions())
+                    if (first || instr.type == InstrType::PHI)
+                        visit(instr, to);
+                if (first && !terminator(to))
+                    for (auto* s : to->successors())
+                        flow.emplace_back(to, s);
+                continue;
+            }
+
+            u64 v = changed_values.back();
+            changed_values.pop_back();
+            for (auto [user, b] : users[v])
+                if (executable.count(b))
+                    visit(*user, b);
+        }
+
+        // a branch on a value that never got evaluated keeps both edges
+        bool forced = false;
+        for (auto* b : executable) {
+            auto* branch = terminator(b);
+            if (branch && value_of(branch->x).state == Lattice::TOP && undecided.insert(b).second) {
+                visit(*branch, b);
+                forced = true;
+            }
+        }
+        if (!forced)
+            break;
+    }
+
+    std::unordered_map<u64, u64> replace;
+    std::unordered_map<Block*, bool> folds; // block -> branch taken
+    for (auto* b : order) {
+        if (!executable.count(b))
+            continue;
+
+        auto* branch = terminator(b);
+        auto c = branch ? value_of(branch->x) : Lattice {};
+        if (c.state == Lattice::CONST && !undecided.count(b))
+            folds[b] = is_taken(branch->type, c.val);
+
+        bool has_x = false, has_y = false;
+        for (auto* p : preds[b]) {
+            if (edges.count({ p, b })) {
+                has_x |= !b->is_phi_y(p);
+                has_y |= b->is_phi_y(p);
+            }
+        }
+
+        for (auto& instr : b->get_instructions()) {
+            if (!is_foldable(instr.type))
+                continue;
+            auto val = value_of(instr.pos);
+            if (val.state == Lattice::CONST)
+                replace[instr.pos] = get_const(ssa, val.val);
+            else if (instr.type == InstrType::PHI && has_x != has_y) {
+                auto src = has_x ? instr.x : instr.y;
+                replace[instr.pos] = src ? *src : get_const(ssa, 0);
+            }
+        }
+    }
+
+    const auto resolve = [&](ValueId& v) {
+        if (!v)
+            return;
+        for (auto it = replace.find(*v); it != replace.end(); it = replace.find(*v))
+            v = it->second;
+    };
+
+    bool changed = !replace.empty();
+    for (auto* b : order) {
+        if (!executable.count(b))
+            continue;
+
+        auto& instrs = b->get_instructions();
+        instrs.remove_if([&](const Instr& instr) { return replace.count(instr.pos); });
+        for (auto& instr : instrs) {
+            if (instr.isValueX())
+                resolve(instr.x);
+            if (instr.isValueY())
+                resolve(instr.y);
+        }
+
+        auto fold = folds.find(b);
+        if (fold != folds.end()) {
+            instrs.pop_back();
+            (fold->second ? b->left : b->right) = nullptr;
+            changed = true;
+        }
+    }
+
+    // unlink the unreachable blocks, they stay in the arena until the ssa goes
+    for (auto* b : order) {
+        bool reachable = executable.count(b);
+        changed |= !reachable;
+        for (auto* link : { &b->left, &b->right, &b->parent_left, &b->parent_right, &b->entry }) {
+            if (*link && (!reachable || !executable.count(*link)))
+                *link = nullptr;
+        }
+        if (!reachable)
+            b->get_instructions().clear();
+    }
+
+    if (!folds.empty() || executable.size() != order.size())
+        ssa.invalidate_cfg();
+    return changed;
+}
@@ -0,0 +1,280 @@
+#include "server.h"
+#include "budget.h"
+#include "compiler.h"
+#include "pool.h"
+
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// arena chunks up to this size are kept between requests
+#define SERVE_ARENA_CHUNK (1 << 20)
+// a thread lets go of its arenas after a request that took more than this
+#define SERVE_ARENA_WARM (16 << 20)
+
+static bool read_all(int fd, void* data, size_t size)
+{
+    char* p = (char*)data;
+    while (size) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void* data, size_t size)
+{
+    const char* p = (const char*)data;
+    while (size) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static std::optional<sockaddr_un> address(const std::filesystem::path& socket)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket.native().size() >= sizeof(addr.sun_path))
+        return std::nullopt;
+    std::strcpy(addr.sun_path, socket.c_str());
+    return addr;
+}
+
+// removes a socket left at the path, false if something else is there
+static bool remove_socket(const std::filesystem::path& socket)
+{
+    struct stat st;
+    if (lstat(socket.c_str(), &st) != 0)
+        return errno == ENOENT;
+    return S_ISSOCK(st.st_mode) && unlink(socket.c_str()) == 0;
+}
+
+// The output of the source into out, or what went wrong. The arenas of the ir
+// come from memory through the budget, the most they held goes to peak.
+static ServeStatus compile(std::string_view source, ServeOutput output, bool opt, const ServeOptions& options,
+    std::pmr::memory_resource* memory, i64& peak, std::string& out)
+{
+    Budget budget(options.budget_bytes, options.budget_time, memory);
+    try {
+        Compiler compiler({ 1, opt, &budget });
+        std::ostringstream os;
+        bool ok = compiler.compile(source);
+        budget.check();
+        if (ok) {
+            switch (output) {
+            case ServeOutput::IR:
+                ok = compiler.ssa(os);
+                break;
+            case ServeOutput::DOT:
+                ok = compiler.dot(os);
+                break;
+            case ServeOutput::ASM:
+                ok = compiler.assembly(os);
+                break;
+            }
+        }
+        if (!ok) {
+            os.str("");
+            for (auto& error : compiler.errors())
+                os << error << "\n";
+        }
+        out = os.str();
+        peak = budget.peak();
+        return ok ? ServeStatus::OK : ServeStatus::ERROR;
+    } catch (const BudgetExceeded& e) {
+        out = e.what();
+        peak = budget.peak();
+        return ServeStatus::BUDGET;
+    } catch (const std::exception& e) {
+        out = e.what();
+        peak = budget.peak();
+        return ServeStatus::ERROR;
+    }
+}
+
+Server::Server(std::filesystem::path socket, const ServeOptions& options)
+    : socket(std::move(socket))
+    , options(options)
+{
+}
+
+bool Server::run()
+{
+    auto addr = address(socket);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (!addr || fd < 0 || !remove_socket(socket)) {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    if (bind(fd, (sockaddr*)&*addr, sizeof(*addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return false;
+    }
+    int wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake < 0) {
+        close(fd);
+        return false;
+    }
+    this->wake = wake;
+
+    // This thread waits on the idle connections and hands every request to
+    // the pool, whose waiting thread only runs tasks in wait(). A connection
+    // comes back to the poll once its request is answered.
+    ThreadPool pool(std::max(options.jobs, 1u) + 1);
+    std::vector<int> idle;
+    std::vector<pollfd> fds;
+    while (!stopping) {
+        {
+            std::lock_guard guard(lock);
+            idle.insert(idle.end(), answered.begin(), answered.end());
+            answered.clear();
+        }
+        fds.assign({ { fd, POLLIN, 0 }, { wake, POLLIN, 0 } });
+        for (int conn : idle)
+            fds.push_back({ conn, POLLIN, 0 });
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        u64 count;
+        if (fds[1].revents && read(wake, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            break;
+        idle.clear();
+        for (size_t i = 2; i < fds.size(); i++) {
+            int conn = fds[i].fd;
+            if (fds[i].revents)
+                pool.submit([this, conn]() { serve(conn); });
+            else
+                idle.push_back(conn);
+        }
+        if (fds[0].revents & POLLIN) {
+            int conn = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (conn >= 0)
+                idle.push_back(conn);
+            else if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN)
+                break;
+        }
+    }
+
+    // requests being served are answered, then every connection is closed
+    pool.wait();
+    for (int conn : idle)
+        close(conn);
+    for (int conn : answered)
+        close(conn);
+    answered.clear();
+    this->wake = -1;
+    close(wake);
+    close(fd);
+    remove_socket(socket);
+    return true;
+}
+
+void Server::stop()
+{
+    stopping = true;
+    int fd = wake;
+    if (fd >= 0) {
+        u64 one = 1;
+        [[maybe_unused]] ssize_t n = write(fd, &one, sizeof(one));
+    }
+}
+
+void Server::serve(int fd)
+{
+    // grown by the largest request a thread has seen and kept
+    thread_local std::string source, out;
+    // the arenas of one request go back here and serve the next one on the
+    // thread, unless the request was large
+    thread_local std::pmr::unsynchronized_pool_resource arenas({ 0, SERVE_ARENA_CHUNK });
+
+    ServeRequest request;
+    if (!read_all(fd, &request, sizeof(request))) {
+        close(fd);
+        return;
+    }
+
+    ServeResponse response;
+    if (request.size > options.max_source) {
+        out = "source too large";
+        response.status = ServeStatus::BUDGET;
+        response.size = out.size();
+        if (write_all(fd, &response, sizeof(response)))
+            write_all(fd, out.data(), out.size());
+        close(fd);
+        return;
+    }
+
+    source.resize(request.size);
+    if (!read_all(fd, source.data(), source.size())) {
+        close(fd);
+        return;
+    }
+    i64 peak;
+    response.status = compile(source, request.output, request.opt, options, &arenas, peak, out);
+    if (peak > SERVE_ARENA_WARM)
+        arenas.release();
+    response.size = out.size();
+    if (!write_all(fd, &response, sizeof(response)) || !write_all(fd, out.data(), out.size())) {
+        close(fd);
+        return;
+    }
+
+    std::lock_guard guard(lock);
+    answered.push_back(fd);
+    u64 one = 1;
+    [[maybe_unused]] ssize_t n = write(wake, &one, sizeof(one));
+}
+
+ServeClient::~ServeClient()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+bool ServeClient::connect(const std::filesystem::path& socket)
+{
+    auto addr = address(socket);
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return addr && fd >= 0 && ::connect(fd, (sockaddr*)&*addr, sizeof(*addr)) == 0;
+}
+
+std::optional<std::pair<ServeStatus, std::string>> ServeClient::compile(std::string_view source, ServeOutput output, bool opt)
+{
+    ServeRequest request;
+    request.size = source.size();
+    request.output = output;
+    request.opt = opt;
+    // a server that turns the request down answers before it has all of it
+    if (write_all(fd, &request, sizeof(request)))
+        write_all(fd, source.data(), source.size());
+
+    ServeResponse response;
+    if (!read_all(fd, &response, sizeof(response)))
+        return std::nullopt;
+    std::string out(response.size, '\0');
+    if (!read_all(fd, out.data(), out.size()))
+        return std::nullopt;
+    return std::make_pair(response.status, std::move(out));
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Requests and responses are a header followed by size bytes of source or
+// output, in host byte order as both ends are on one machine. A connection
+// takes any number of requests, one after the other.
+enum class ServeOutput : u8 {
+    IR,
+    DOT,
+    ASM,
+};
+
+enum class ServeStatus : u8 {
+    OK,
+    ERROR, // the output is the error
+    BUDGET, // the request ran out of time or memory, or the source is too large
+};
+
+struct ServeRequest {
+    u32 size;
+    ServeOutput output;
+    bool opt;
+    u8 pad[2] = {};
+};
+
+struct ServeResponse {
+    u32 size;
+    ServeStatus status;
+    u8 pad[3] = {};
+};
+
+struct ServeOptions {
+    unsigned jobs = 1; // requests compiled at once
+    size_t budget_bytes = 256 << 20;
+    std::chrono::milliseconds budget_time { 2000 };
+    u32 max_source = 16 << 20;
+};
+
+// Compile server on a unix socket. The thread in run() polls the open
+// connections and every request that comes in is compiled by a task on a pool
+// of jobs threads, an idle connection holds no thread. The threads keep their
+// buffers and the arenas of the ir between requests. The ir of every request
+// is allocated from a Budget.
+class Server {
+public:
+    Server(std::filesystem::path socket, const ServeOptions& options);
+
+    // accepts connections until stop() and returns once they are closed,
+    // false if the socket could not be set up, a path taken by anything but
+    // a socket is left alone
+    bool run();
+    // ends run(), also from a signal handler
+    void stop();
+
+private:
+    std::filesystem::path socket;
+    ServeOptions options;
+    std::atomic<int> wake = -1; // eventfd that interrupts the poll
+    std::atomic<bool> stopping = false;
+
+    std::mutex lock;
+    std::vector<int> answered; // connections to poll again
+
+    // answers one request and hands the connection back, or closes it
+
+    void serve(int fd);
+};
+
+// one connection to a server
+class ServeClient {
+public:
+    ~ServeClient();
+
+    bool connect(const std::filesystem::path& socket);
+    // the status and output, nothing once the connection is gone
+    std::optional<std::pair<ServeStatus, std::string>> compile(std::string_view source, ServeOutput output, bool opt = true);
+
+private:
+    int fd = -1;
+};
@@ -4,27 +4,30 @@
 #include <algorithm>
 #include <ostream>
 
-u64 Block::__id = 0;
-u64 SSA::instruction_num = 0;
-
-SSA::SSA()
-    : blocks(std::make_shared<Block>())
+SSA::SSA(std::pmr::memory_resource* memory)
+    : arena(memory)
+    , blocks(new_block())
     , current(blocks)
 {
     add_block(true);
 }
 
-std::shared_ptr<Block> SSA::reverse_block()
+Block* SSA::new_block()
+{
+    return new (arena.allocate(sizeof(Block), alignof(Block))) Block(block_count++, &pool, &arena);
+}
+
+Block* SSA::reverse_block()
 {
     auto t = current;
     current = current->parent_left;
     return t;
 }
 
-std::shared_ptr<Block> SSA::add_block(bool isLeft)
+Block* SSA::add_block(bool isLeft)
 {
     auto p = current;
-    current = std::make_shared<Block>();
+    current = new_block();
     current->parent_left = p;
     if (isLeft) {
         p->left = current;
@@ -45,9 +48,8 @@ void SSA::add_const(u64 val)
     }
 
     Instr instr;
-    instr.type = InstrType::CONST;
-    instr.x = val;
-    instr.pos = instruction_num++;
+    instr.set_literal(val);
+    instr.pos = next_pos();
     last_instr_pos = instr.pos;
     constants[val] = instr.pos;
 
@@ -55,22 +57,6 @@ void SSA::add_const(u64 val)
     add_stack(constants[val]);
 }
 
-static bool isBranch(InstrType type)
-{
-    switch (type) {
-    case InstrType::BNE:
-    case InstrType::BEQ:
-    case InstrType::BLE:
-    case InstrType::BLT:
-    case InstrType::BGT:
-    case InstrType::BGE:
-        return true;
-    default:
-        break;
-    }
-    return false;
-}
-
 void SSA::add_instr(InstrType type)
 {
     Instr __instr;
@@ -127,7 +113,9 @@ void SSA::add_instr(InstrType type)
     case InstrType::JUMP:
     case InstrType::RET:
         assert(instr_stack.size() >= 1 && "Not enough options");
-        instr->x = instr_stack.top();
+        // a void return has no value
+        if (instr_stack.top() != (u64)-1)
+            instr->x = instr_stack.top();
         instr_stack.pop();
         break;
     case InstrType::GETP:
@@ -146,12 +134,12 @@ void SSA::add_instr(InstrType type)
         ERROR("PHI should not be created directly in %s\n", __func__);
         break;
     default:
-        ERROR("Unknown InstrType\n");
-        exit(1);
+        throw std::runtime_error("Unknown InstrType");
     }
 
-    if (instr->isHashable() && expressions.find(*instr) != expressions.end()) {
-        last_instr_pos = expressions[*instr];
+    auto known = instr->isHashable() ? expressions.find(*instr) : std::nullopt;
+    if (known) {
+        last_instr_pos = *known;
         if (add_to_stack)
             add_stack(get_last_pos());
         instr->type = InstrType::NONE;
@@ -165,7 +153,8 @@ void SSA::add_instr(InstrType type)
     }
 
     if (instr->isHashable())
-        expressions[*instr] = get_last_pos();
+        expressions.insert(*instr, get_last_pos());
+    add_uses(get_instr(get_last_pos()));
 
     if (add_to_stack)
         add_stack(get_last_pos());
@@ -173,15 +162,15 @@ void SSA::add_instr(InstrType type)
 
 void SSA::add_to_block(Instr instr)
 {
-    instr.pos = instruction_num++;
+    instr.pos = next_pos();
     last_instr_pos = instr.pos;
     current->add_back(std::move(instr));
 }
 
 // NOTE: adds to front of stack, useful for phi
-Instr& SSA::add_to_block(Instr&& instr, std::shared_ptr<Block>& join_block)
+Instr& SSA::add_to_block(Instr&& instr, Block* join_block)
 {
-    instr.pos = instruction_num++;
+    instr.pos = next_pos();
     // last_instr_pos = instr.pos; NOTE: idk if i need this
     return join_block->add_front(std::move(instr));
 }
@@ -192,23 +181,21 @@ void SSA::add_symbols(SymbolTableType&& v)
     INFO("symbol_table size %zu\n", symbol_table.size());
 }
 
-void SSA::set_symbol(const Token* t)
+void SSA::set_symbol(u64 id, std::string_view name)
 {
-    if (symbol_table.find(*t->val()) == symbol_table.end()) {
-        LOG_ERROR("[ERROR] Unknown symbol '%s'\n", t->id().c_str());
-        exit(1);
-    }
+    if (symbol_table.find(id) == symbol_table.end())
+        throw std::runtime_error("Unknown symbol '" + std::string(name) + "'");
     u64 pos = instr_stack.top();
     instr_stack.pop();
 
     if (!join_stack.empty() && join_stack.back().isLeft.has_value()) {
         auto& [join_block, isBranchLeft, idToPhi, whileInfo] = join_stack.back();
         Instr* phi;
-        if (idToPhi.find(*t->val()) != idToPhi.end()) {
-            phi = idToPhi[*t->val()];
+        if (idToPhi.find(id) != idToPhi.end()) {
+            phi = &get_instr(idToPhi[id]);
         } else {
             // NOTE: should never reach
-            PRTOKLN(*t);
+            LOG_ERROR("%s\n", std::string(name).c_str());
             print_symbol_table();
             std::cout << *this;
             throw std::runtime_error("unreachable " + std::string(__func__));
@@ -221,9 +208,10 @@ void SSA::set_symbol(const Token* t)
             }
             phi->y = pos;
         }
+        add_uses(*phi);
     }
-    INFO("Setting %s = %llu\n", t->id().c_str(), pos);
-    symbol_table[*t->val()].second = pos;
+    INFO("Setting %s = %llu\n", std::string(name).c_str(), pos);
+    symbol_table[id].second = pos;
 }
 
 std::vector<std::pair<u64, u64>> SSA::add_symbols_to_block(JoinNodeType& join_node)
@@ -239,22 +227,22 @@ std::vector<std::pair<u64, u64>> SSA::add_symbols_to_block(JoinNodeType& join_no
         p.type = InstrType::PHI;
         p.x = s.second;
         p.y = p.x;
-        join_node.idToPhi[k] = &add_to_block(std::move(p), join_node.node);
+        auto& phi = add_to_block(std::move(p), join_node.node);
+        add_uses(phi);
+        join_node.idToPhi[k] = phi.pos;
     }
     return old_symbols;
 }
 
 // resolves symbol and adds to option stack
 // for functions returns true if isVoid
-bool SSA::resolve_symbol(const Token* t)
+bool SSA::resolve_symbol(u64 id, std::string_view name)
 {
-    if (symbol_table.find(*t->val()) == symbol_table.end()) {
-        LOG_ERROR("[ERROR] Unknown symbol '%s'\n", t->id().c_str());
-        exit(1);
-    }
+    if (symbol_table.find(id) == symbol_table.end())
+        throw std::runtime_error("Unknown symbol '" + std::string(name) + "'");
 
     u64 opt = 0;
-    switch (*t->val()) {
+    switch (id) {
     case FUNC_INPUT_NUM: // no opt
         add_instr(InstrType::READ);
         return false; // is not void
@@ -265,11 +253,11 @@ bool SSA::resolve_symbol(const Token* t)
         add_instr(InstrType::WRITENL);
         return true;
     default:
-        auto& [_, val] = symbol_table[*t->val()];
+        auto& [_, val] = symbol_table[id];
         if (val.has_value()) {
             opt = val.value();
         } else {
-            WARN("uninitialized symbol '%s'\n", t->id().c_str());
+            WARN("uninitialized symbol '%s'\n", std::string(name).c_str());
             add_const(0);
             val = instr_stack.top();
             opt = val.value();
@@ -291,7 +279,7 @@ void SSA::restore_symbol_state(std::vector<std::pair<u64, u64>>& old_symbols)
     }
 }
 
-void SSA::resolve_branch(std::shared_ptr<Block>& from, std::shared_ptr<Block>& to)
+void SSA::resolve_branch(Block* from, Block* to)
 {
     assert(to->instructions.size() != 0);
     auto& instr_pos = to->instructions.front().pos;
@@ -299,84 +287,91 @@ void SSA::resolve_branch(std::shared_ptr<Block>& from, std::shared_ptr<Block>& t
     p.back().y = instr_pos;
 }
 
-std::vector<std::pair<u64, u64>> SSA::resolve_phi(std::unordered_map<u64, Instr*>& idToPhi)
+std::vector<std::pair<u64, u64>> SSA::resolve_phi(std::unordered_map<u64, u32>& idToPhi)
 {
     std::vector<std::pair<u64, u64>> old_symbols;
     for (auto& [id, phi] : idToPhi) {
-        INFO("Resolving phi of %s = %llu\n", symbol_table[id].first.c_str(), phi->pos);
-        symbol_table[id].second = phi->pos;
-        old_symbols.emplace_back(id, phi->pos);
+        INFO("Resolving phi of %s = %u\n", symbol_table[id].first.c_str(), phi);
+        symbol_table[id].second = phi;
+        old_symbols.emplace_back(id, phi);
     }
     return old_symbols;
 }
 
-// if phi.x == phi.y should resolve to phi.x and phi.x should be propogated until left and right nullptr update outer too
-void SSA::commit_phi(std::unordered_map<u64, Instr*>& idToPhi, bool isIf)
+void SSA::add_uses(const Instr& instr)
 {
-    std::vector<u64> erase_queue;
-    std::vector<u64> erase_queue2;
-
-    std::function<void(Block*, u64, u64)> propagate_changes = [&](Block* start, u64 from, u64 to) {
-        u64 idx = 0;
-        std::vector<u64> eq;
-        for (auto it = start->instructions.begin(); it != start->instructions.end(); ++it) {
-            auto& instr = *it;
-            if (instr.pos == from)
+    for (auto [v, is_value] : { std::make_pair(instr.x, instr.isValueX()), std::make_pair(instr.y, instr.isValueY()) }) {
+        if (!is_value || !v)
+            continue;
+        if (*v >= uses.size())
+            uses.resize(*v + 1);
+        uses[*v].push_back(instr.pos);
+    }
+}
+
+// Rewrites the readers of from to read to instead. A reader that turns into an
+// expression that already exists hands its own readers over to it and is left
+// behind as dead code, symbols may still name it.
+void SSA::replace_uses(u32 from, u32 to)
+{
+    std::vector<std::pair<u32, u32>> work = { { from, to } };
+    while (!work.empty()) {
+        auto [old_val, new_val] = work.back();
+        work.pop_back();
+        if (old_val == new_val || old_val >= uses.size())
+            continue;
+        auto users = std::move(uses[old_val]);
+        uses[old_val] = {};
+        use_visits += users.size();
+        for (u32 user : users) {
+            auto& instr = get_instr(user);
+            // param numbers and literals are not values, numbers are per
+            // function so they easily match one
+            bool x = instr.isValueX() && instr.x == old_val;
+            bool y = instr.isValueY() && instr.y == old_val;
+            if (instr.pos == old_val || (!x && !y))
                 continue;
-            if (instr.x == from || instr.y == from) {
-                if (instr.x == from) {
-                    instr.x = to;
-                }
-                if (instr.y == from) {
-                    instr.y = to;
-                }
-                if (instr.isHashable() && expressions.find(instr) != expressions.end()) {
-                    propagate_changes(blocks.get(), instr.pos, expressions[instr]);
-                    eq.push_back(idx);
-                }
+            if (x)
+                instr.x = new_val;
+            if (y)
+                instr.y = new_val;
+            add_uses(instr);
+            if (instr.isHashable()) {
+                auto known = expressions.find(instr);
+                if (known && *known != instr.pos)
+                    work.emplace_back(instr.pos, *known);
             }
-            idx++;
         }
+    }
+}
 
-        std::sort(eq.begin(), eq.end(), std::greater<u64>());
-        for (auto& e : eq)
-            start->instructions.erase(start->instructions.begin() + e);
-
-        if (start->left) {
-            propagate_changes(start->left.get(), from, to);
-        }
-        if (start->right) {
-            propagate_changes(start->right.get(), from, to);
-        }
-    };
+// if phi.x == phi.y should resolve to phi.x and the readers of the phi read phi.x, update outer too
+void SSA::commit_phi(std::unordered_map<u64, u32>& idToPhi, bool isIf)
+{
+    std::vector<u64> erase_queue;
+    std::unordered_set<u32> trivial;
 
-    for (auto& [id, phi] : idToPhi) {
+    for (auto& [id, phi_pos] : idToPhi) {
+        Instr* phi = &get_instr(phi_pos);
         // check for cyclic reference
         if (phi->pos == phi->y) {
             phi->y = phi->x;
         } else if (phi->pos == phi->x) {
             phi->x = phi->y;
         }
+        add_uses(*phi);
 
         if (phi->x == phi->y) {
-            auto& instrs = join_stack.back().node->instructions;
             if (phi->x.has_value()) {
-                propagate_changes(join_stack.back().node.get(), phi->pos, phi->x.value());
+                replace_uses(phi->pos, phi->x.value());
                 symbol_table[id].second = phi->x; // update symbol table
             }
 
             // remove instruction from block
             if (!isIf)
                 erase_queue.emplace_back(id);
-            u64 it = 0;
-            for (auto& instr : instrs) {
-                if (phi->pos == instr.pos) {
-                    INFO("ERASING %s == %llu\n", symbol_table[id].first.c_str(), phi->pos);
-                    erase_queue2.push_back(it);
-                    break;
-                }
-                it++;
-            }
+            INFO("ERASING %s == %u\n", symbol_table[id].first.c_str(), phi->pos);
+            trivial.insert(phi->pos);
         }
     }
 
@@ -387,27 +382,28 @@ void SSA::commit_phi(std::unordered_map<u64, Instr*>& idToPhi, bool isIf)
         auto& outer = join_stack[join_stack.size() - 2];
         for (auto& i : idToPhi) {
             if (outer.idToPhi.find(i.first) != outer.idToPhi.end()) {
-                if (outer.idToPhi[i.first]->y)
-                    INFO("Setting %llu to %llu\n", outer.idToPhi[i.first]->y.value(), i.second->pos);
-                auto& toUpdate = outer.idToPhi[i.first];
-                auto updatedVal = i.second->pos;
-                if (isIf && i.second->x == i.second->y) {
-                    updatedVal = i.second->x.value_or(updatedVal);
+                auto* toUpdate = &get_instr(outer.idToPhi[i.first]);
+                auto& phi = get_instr(i.second);
+                if (toUpdate->y)
+                    INFO("Setting %llu to %u\n", toUpdate->y.value(), phi.pos);
+                u64 updatedVal = phi.pos;
+                if (isIf && phi.x == phi.y) {
+                    updatedVal = phi.x.value_or(updatedVal);
                 }
-                if (toUpdate->x == toUpdate->y) {
+                // same as set_symbol, the side is decided by the branch of the outer join
+                if (outer.isLeft.value_or(false)) {
                     toUpdate->x = updatedVal;
                 } else {
+                    if (!toUpdate->x.has_value())
+                        toUpdate->x = updatedVal;
                     toUpdate->y = updatedVal;
                 }
+                add_uses(*toUpdate);
             }
         }
     }
 
-    std::sort(erase_queue2.begin(), erase_queue2.end(), std::greater<u64>()); // sort descending
-
-    auto& back = join_stack.back().node->instructions;
-    for (auto& e : erase_queue2)
-        back.erase(back.begin() + e);
+    join_stack.back().node->instructions.remove_if([&](const Instr& instr) { return trivial.count(instr.pos); });
 
     if (join_stack.back().node->instructions.empty()) {
         auto current = get_current_block();
@@ -418,6 +414,55 @@ void SSA::commit_phi(std::unordered_map<u64, Instr*>& idToPhi, bool isIf)
     assert(!join_stack.back().node->instructions.empty());
 }
 
+std::vector<Block*> Block::successors() const
+{
+    if (!instructions.empty() && isBranch(instructions.back().type)) {
+        assert(left && right);
+        return { left, right };
+    }
+    // back edge of a while loop
+    if (entry)
+        return { entry };
+    // end of the then branch jumps to the join block
+    if (right)
+        return { right };
+    if (left)
+        return { left };
+    return {};
+}
+
+// reverse post order keeps fall through blocks close to their predecessor
+std::vector<Block*> SSA::reverse_post_order() const
+{
+    std::vector<Block*> order;
+    std::unordered_set<Block*> seen;
+    std::function<void(Block*)> visit = [&](Block* b) {
+        if (!seen.insert(b).second)
+            return;
+        auto succ = b->successors();
+        for (auto it = succ.rbegin(); it != succ.rend(); ++it)
+            visit(*it);
+        order.push_back(b);
+    };
+    visit(blocks);
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+const DominatorTree& SSA::dominators() const
+{
+    if (!dom_tree)
+        dom_tree.emplace(reverse_post_order());
+    return *dom_tree;
+}
+
+const LoopNest& SSA::loops() const
+{
+    if (!loop_nest)
+        loop_nest.emplace(dominators());
+    return *loop_nest;
+}
+
 /// DOT GENERATION ///
 
 // Record:      bb0 [shape=record, label="<b>BB0 | {3: const #0}"]
@@ -426,7 +471,7 @@ void SSA::commit_phi(std::unordered_map<u64, Instr*>& idToPhi, bool isIf)
 // block = b
 // instr_top = n
 // instr_bot = s
-void SSA::generate_dot() const
+void SSA::generate_dot(std::ostream& os) const
 {
     using namespace std::string_literals;
 
@@ -452,13 +497,13 @@ void SSA::generate_dot() const
         }
         seen.insert(block->get_block_id());
 
-        std::cout << record_start(block->block_id);
+        os << record_start(block->block_id);
         for (auto& instr : block->instructions) {
-            std::cout << instr;
+            os << instr;
             if (&instr != &block->instructions.back())
-                std::cout << "|";
+                os << "|";
         }
-        std::cout << record_end() << std::endl;
+        os << record_end() << std::endl;
 
         std::string primary_str = "";
         std::string secondary_str = "fall";
@@ -467,32 +512,32 @@ void SSA::generate_dot() const
         }
         // parent_right is unused
         if (block->parent_left && block->parent_left->left && block->parent_left->right) {
-            primary_str = block->parent_left->right.get() == block ? "branch" : "fall";
+            primary_str = block->parent_left->right == block ? "branch" : "fall";
         }
         if (block->parent_left) {
-            std::cout << create_link(block->parent_left->block_id, block->block_id, primary_str) << std::endl;
+            os << create_link(block->parent_left->block_id, block->block_id, primary_str) << std::endl;
         }
         if (block->parent_right) {
-            std::cout << create_link(block->parent_right->block_id, block->block_id, secondary_str) << std::endl;
+            os << create_link(block->parent_right->block_id, block->block_id, secondary_str) << std::endl;
         }
-        if (block->dominator)
-            std::cout << create_dominator(block->dominator->block_id, block->block_id) << std::endl;
+        if (auto* idom = dominators().idom(block))
+            os << create_dominator(idom->block_id, block->block_id) << std::endl;
         if (block->entry)
-            std::cout << create_link(block->block_id, block->entry->block_id, "branch") << std::endl;
+            os << create_link(block->block_id, block->entry->block_id, "branch") << std::endl;
 
         if (block->left)
-            p_blocks(block->left.get());
+            p_blocks(block->left);
         if (block->right)
-            p_blocks(block->right.get());
+            p_blocks(block->right);
     };
-    std::cout << "digraph " << this->name << " {\n";
-    p_blocks(this->blocks.get());
-    std::cout << "}\n";
+    os << "digraph " << this->name << " {\n";
+    p_blocks(this->blocks);
+    os << "}\n";
 }
 
 /// PRINTS
 
-void SSA::print_symbol_table()
+void SSA::print_symbol_table() const
 {
     std::cerr << "Instruction Stack Size: " << instr_stack.size() << std::endl;
     std::cerr << "Inbuilt symbols: " << inbuilt_count << std::endl;
@@ -524,11 +569,11 @@ std::ostream& operator<<(std::ostream& os, const SSA& ssa)
         if (block->right || block->left)
             os << std::string(indent, ' ') << "└───────────────┐" << std::endl;
         if (block->left)
-            p_blocks(block->left.get(), indent + 16);
+            p_blocks(block->left, indent + 16);
         if (block->right)
-            p_blocks(block->right.get(), indent + 16);
+            p_blocks(block->right, indent + 16);
     };
-    p_blocks(ssa.blocks.get(), 0);
+    p_blocks(ssa.blocks, 0);
 
     return os;
 }
@@ -616,7 +661,7 @@ std::ostream& operator<<(std::ostream& os, const Instr& instr)
         os << "bra " << *instr.y;
         break;
     case InstrType::CONST:
-        os << "const #" << *instr.x;
+        os << "const #" << instr.literal();
         break;
     case InstrType::WRITE:
         os << "write " << *instr.x;
@@ -637,7 +682,9 @@ std::ostream& operator<<(std::ostream& os, const Instr& instr)
         os << "jsr " << *instr.x;
         break;
     case InstrType::RET:
-        os << "ret " << (int64_t)*instr.x;
+        os << "ret";
+        if (instr.x)
+            os << " " << *instr.x;
         break;
     case InstrType::NONE:
         os << "none";
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <deque>
 #include <iostream>
+#include <memory_resource>
 
+#include "dominance.h"
+#include "instr.h"
+#include "loop.h"
 #include "token.h"
+#include "value_table.h"
 
 // InputNum, OutputNum, OutputNewLine
 #define FUNC_INPUT_NUM 0
@@ -15,138 +22,153 @@ typedef std::map<u64, SymbolType> SymbolTableType;
 
 // token id -> jump pos, param count
 struct FunctionType {
-    u64 pos;
+    u64 pos; // x of the jump, same as index
     u64 paramCount;
     bool isVoid; // true -> int, otherwise void
+    u64 index; // index of the function ssa in Parser::get_ir()
 };
 
 typedef std::unordered_map<u64, FunctionType> FunctionMap;
 
-enum class InstrType {
-    CONST, // const #x define an SSA value for a constant
-    ADD, // add x y addition
-    SUB, // sub x y subtraction
-    MUL, // mul x y multiplication
-    DIV, // div x y division
-    CMP, // cmp x y comparison
-    PHI, // phi x1 x2 compute Phi(x1,    x2)
-    BRA, // bra y branch to y
-    BNE, // bne x y branch to y on x not equal
-    BEQ, // beq x y branch to y on x equal
-    BLE, // ble x y branch to y on x less or equal
-    BLT, // blt x y branch to y on x less
-    BGE, // bge x y branch to y on x greater or equal
-    BGT, // bgt x y branch to y on x greater
-
-    // Inbuilt Functions
-    READ,
-    WRITE,
-    WRITENL,
-
-    // Functions
-    JUMP,
-    RET,
-    SETP,
-    GETP,
-
-    END,
-    NONE,
-    UNKNOWN,
-};
+// jump operand -> index of the function ssa, how the backends resolve calls
+inline std::unordered_map<u64, u32> function_indices(const FunctionMap& functions)
+{
+    std::unordered_map<u64, u32> indices;
+    for (const auto& [_, f] : functions)
+        indices[f.pos] = f.index;
+    return indices;
+}
+
+// every instruction of a function, indexed by its number
+typedef std::pmr::deque<Instr> InstrPool;
+
+// A block only keeps the numbers of its instructions in order, the instructions
+// stay in the pool of the function so references to them survive any edit of
+// the block. Iterators walk the numbers and hand out the instructions.
+class InstrList {
+public:
+    template <typename T>
+    class Iter {
+        typedef std::pmr::vector<u32>::const_iterator Base;
+        Base it;
+        InstrPool* pool = nullptr;
+        friend InstrList;
+        template <typename U>
+        friend class Iter;
+
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef Instr value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T* pointer;
+        typedef T& reference;
+
+        Iter() = default;
+        Iter(Base it, InstrPool* pool)
+            : it(it)
+            , pool(pool)
+        {
+        }
+        // iterator converts to const_iterator
+        template <typename U, typename = std::enable_if_t<std::is_const_v<T> && !std::is_const_v<U>>>
+        Iter(const Iter<U>& other)
+            : it(other.it)
+            , pool(other.pool)
+        {
+        }
 
-struct Instr {
-    u64 pos;
-    InstrType type;
-    std::optional<u64> x, y;
-    bool operator==(const Instr& other) const
+        inline T& operator*() const { return (*pool)[*it]; }
+        inline T* operator->() const { return &(*pool)[*it]; }
+        inline T& operator[](difference_type n) const { return (*pool)[it[n]]; }
+        inline Iter& operator++() { return ++it, *this; }
+        inline Iter& operator--() { return --it, *this; }
+        inline Iter operator++(int) { return { it++, pool }; }
+        inline Iter operator--(int) { return { it--, pool }; }
+        inline Iter& operator+=(difference_type n) { return it += n, *this; }
+        inline Iter& operator-=(difference_type n) { return it -= n, *this; }
+        inline Iter operator+(difference_type n) const { return { it + n, pool }; }
+        inline Iter operator-(difference_type n) const { return { it - n, pool }; }
+        friend inline Iter operator+(difference_type n, const Iter& i) { return i + n; }
+        inline difference_type operator-(const Iter& other) const { return it - other.it; }
+        inline bool operator==(const Iter& other) const { return it == other.it; }
+        inline bool operator!=(const Iter& other) const { return it != other.it; }
+        inline bool operator<(const Iter& other) const { return it < other.it; }
+        inline bool operator>(const Iter& other) const { return it > other.it; }
+        inline bool operator<=(const Iter& other) const { return it <= other.it; }
+        inline bool operator>=(const Iter& other) const { return it >= other.it; }
+    };
+    typedef Iter<Instr> iterator;
+    typedef Iter<const Instr> const_iterator;
+
+    InstrList(InstrPool* pool, std::pmr::memory_resource* arena)
+        : pool(pool)
+        , ids(arena)
     {
-        if (type != other.type) return false;
-
-        if (x == other.x && y == other.y) return true;
-        if (x == other.y && y == other.x) return true;
-        return false;
     }
 
-    inline bool isHashable() const
+    inline iterator begin() { return { ids.begin(), pool }; }
+    inline iterator end() { return { ids.end(), pool }; }
+    inline const_iterator begin() const { return { ids.begin(), pool }; }
+    inline const_iterator end() const { return { ids.end(), pool }; }
+
+    inline bool empty() const { return ids.empty(); }
+    inline size_t size() const { return ids.size(); }
+    inline Instr& operator[](size_t i) { return (*pool)[ids[i]]; }
+    inline const Instr& operator[](size_t i) const { return (*pool)[ids[i]]; }
+    inline Instr& front() { return (*pool)[ids.front()]; }
+    inline const Instr& front() const { return (*pool)[ids.front()]; }
+    inline Instr& back() { return (*pool)[ids.back()]; }
+    inline const Instr& back() const { return (*pool)[ids.back()]; }
+
+    // stores the instruction under its number, see SSA::next_pos()
+    inline iterator insert(const_iterator at, Instr instr)
     {
-        switch (this->type) {
-        case InstrType::ADD:
-        case InstrType::SUB:
-        case InstrType::MUL:
-        case InstrType::DIV:
-            return true;
-        case InstrType::JUMP:
-        case InstrType::SETP:
-        case InstrType::GETP:
-        case InstrType::RET:
-        case InstrType::PHI:
-        case InstrType::CMP:
-        case InstrType::BRA:
-        case InstrType::BNE:
-        case InstrType::BEQ:
-        case InstrType::BLE:
-        case InstrType::BLT:
-        case InstrType::BGE:
-        case InstrType::BGT:
-        case InstrType::READ:
-        case InstrType::WRITE:
-        case InstrType::WRITENL:
-        case InstrType::END:
-        case InstrType::CONST:
-        case InstrType::NONE:
-        case InstrType::UNKNOWN:
-            break;
-        }
-        return false;
+        assert(instr.pos < pool->size());
+        (*pool)[instr.pos] = instr;
+        return { ids.insert(at.it, instr.pos), pool };
     }
-
-    friend std::ostream& operator<<(std::ostream& os, const Instr& instr);
-};
-
-template <>
-struct std::hash<Instr> {
-    std::size_t operator()(const Instr& instr) const
+    inline Instr& push_back(Instr instr) { return *insert(end(), instr); }
+    inline Instr& push_front(Instr instr) { return *insert(begin(), instr); }
+    inline iterator erase(const_iterator at) { return { ids.erase(at.it), pool }; }
+    inline iterator erase(const_iterator first, const_iterator last) { return { ids.erase(first.it, last.it), pool }; }
+    inline void pop_back() { ids.pop_back(); }
+    inline void clear() { ids.clear(); }
+
+    // drops the instructions matching pred, keeps the order of the rest
+    template <typename Pred>
+    inline void remove_if(Pred pred)
     {
-        using std::hash;
-        using std::size_t;
-        using std::string;
-
-        assert(instr.isHashable());
-
-        return ((hash<int>()((int)instr.type) >> 1) ^ (hash<std::optional<u64>>()(instr.x) ^ hash<std::optional<u64>>()(instr.y)));
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&](u32 id) { return pred((*pool)[id]); }), ids.end());
     }
+
+private:
+    InstrPool* pool;
+    std::pmr::vector<u32> ids;
 };
 
 class SSA;
 class Block {
-    static u64 __id;
-    u64 block_id;
+    u64 block_id; // numbered per function
 
     friend SSA;
 
+    // blocks only live in the arena of their ssa, see SSA::new_block()
+    Block(u64 id, InstrPool* pool, std::pmr::memory_resource* arena)
+        : block_id(id)
+        , instructions(pool, arena)
+    {
+    }
+
 public:
     // NOTE: maybe add sibling property?
-    std::shared_ptr<Block> left, right, parent_left, parent_right, dominator, entry;
+    Block *left = nullptr, *right = nullptr, *parent_left = nullptr, *parent_right = nullptr, *entry = nullptr;
 
-    Block()
-        : block_id(__id++)
-    {
-    }
+    Block(const Block&) = delete;
 
     inline u64 get_block_id() const { return block_id; }
 
-    inline Instr& add_back(Instr&& instr)
-    {
-        instructions.emplace_back(instr);
-        // return instructions.size() - 1;
-        return instructions.back();
-    }
-
-    inline Instr& add_front(Instr&& instr)
-    {
-        instructions.emplace_front(instr);
-        return instructions.front();
-    }
+    inline Instr& add_back(Instr&& instr) { return instructions.push_back(instr); }
+    inline Instr& add_front(Instr&& instr) { return instructions.push_front(instr); }
 
     void print_with_indent(std::ostream& os, u64 indent) const;
 
@@ -155,36 +177,39 @@ public:
     inline Instr& front() { return instructions.front(); }
     inline Instr& back() { return instructions.back(); }
     inline void pop_back() { instructions.pop_back(); }
+    inline const InstrList& get_instructions() const { return instructions; }
+    inline InstrList& get_instructions() { return instructions; }
+
+    // control flow successors, for a conditional branch the fall through (left) comes first
+    std::vector<Block*> successors() const;
+
+    // phis take x from parent_left and y from parent_right or the loop back edge
+    inline bool is_phi_y(const Block* pred) const { return parent_right == pred || pred->entry == this; }
 
 private:
-    std::deque<Instr> instructions;
+    InstrList instructions;
 
-    // NOTE: std::deque instead of vector (allows references to items)
     friend std::ostream& operator<<(std::ostream& os, const Block& b);
 };
 
 typedef struct {
-    std::shared_ptr<Block> node;
+    Block* node;
     std::optional<bool> isLeft;
-    std::unordered_map<u64, Instr*> idToPhi;
-    std::optional<Instr*> whileInfo;
+    std::unordered_map<u64, u32> idToPhi; // symbol -> phi
+    std::optional<u32> whileInfo; // cmp of the loop header
 } JoinNodeType;
 
 class SSA {
 public:
-    SSA();
-
-#ifndef NDEBUG
-    ~SSA()
-    {
-        print_symbol_table();
-    }
-#endif
+    // blocks and instructions are allocated from memory
+    SSA(std::pmr::memory_resource* memory = std::pmr::get_default_resource());
 
-    std::shared_ptr<Block> reverse_block();
-    std::shared_ptr<Block> add_block(bool isLeft);
-    inline void set_current_block(std::shared_ptr<Block> b) { current = b; }
-    inline std::shared_ptr<Block> get_current_block() { return current; }
+    Block* reverse_block();
+    Block* add_block(bool isLeft);
+    inline void set_current_block(Block* b) { current = b; }
+    inline Block* get_current_block() { return current; }
+    // unlinked block owned by the arena, released along with the ssa
+    Block* new_block();
 
     // gets first instr of current block
     inline u64 get_first_instr() const
@@ -204,24 +229,30 @@ public:
 
     // void add_symbols(u64 count);
     void add_symbols(SymbolTableType&& v);
-    void set_symbol(const Token* t);
+    // both throw std::runtime_error on a name that was never declared
+    void set_symbol(u64 id, std::string_view name);
     std::vector<std::pair<u64, u64>> add_symbols_to_block(JoinNodeType& join_node);
 
-    bool resolve_symbol(const Token* t);
+    bool resolve_symbol(u64 id, std::string_view name);
     void restore_symbol_state(std::vector<std::pair<u64, u64>>& old_symbols);
-    void print_symbol_table();
+    void print_symbol_table() const;
 
-    void resolve_branch(std::shared_ptr<Block>& from, std::shared_ptr<Block>& to);
+    void resolve_branch(Block* from, Block* to);
 
-    std::vector<std::pair<u64, u64>> resolve_phi(std::unordered_map<u64, Instr*>& idToPhi);
-    void commit_phi(std::unordered_map<u64, Instr*>& idToPhi, bool isIf = false);
+    std::vector<std::pair<u64, u64>> resolve_phi(std::unordered_map<u64, u32>& idToPhi);
+    void commit_phi(std::unordered_map<u64, u32>& idToPhi, bool isIf = false);
 
     inline u64 get_last_pos() const { return last_instr_pos; }
-    inline Instr* get_cmp()
+    // readers visited while replacing trivial phis, grows with the program
+    inline u64 get_use_visits() const { return use_visits; }
+    // expressions of a branch or loop body are only reused inside of it
+    inline void push_scope() { expressions.push_scope(); }
+    inline void pop_scope() { expressions.pop_scope(); }
+    inline u32 get_cmp()
     {
-        Instr* cmp = &get_current_block()->instructions[get_current_block()->instructions.size() - 2];
-        assert(cmp->type == InstrType::CMP);
-        return cmp;
+        auto& cmp = get_current_block()->instructions[get_current_block()->instructions.size() - 2];
+        assert(cmp.type == InstrType::CMP);
+        return cmp.pos;
     }
 
     inline void add_stack(u64 val) { instr_stack.push(val); }
@@ -230,7 +261,29 @@ public:
     inline u64 size_stack() const { return instr_stack.size(); }
     inline void clear_stack() { instr_stack = {}; };
 
-    void generate_dot() const;
+    void generate_dot(std::ostream& os = std::cout) const;
+
+    inline Block* get_head() const { return blocks; }
+    // dominator tree and loops of the cfg, computed on first use, passes that
+    // change block edges call invalidate_cfg() afterwards
+    const DominatorTree& dominators() const;
+    const LoopNest& loops() const;
+    inline void invalidate_cfg()
+    {
+        loop_nest.reset();
+        dom_tree.reset();
+    }
+    // fresh instruction number, numbers are per function and index the pool
+    inline u32 next_pos()
+    {
+        Instr& instr = pool.emplace_back();
+        instr.pos = pool.size() - 1;
+        assert(instr.pos < ValueId::NONE);
+        return instr.pos;
+    }
+    inline Instr& get_instr(u32 pos) { return pool[pos]; }
+    inline const Instr& get_instr(u32 pos) const { return pool[pos]; }
+    std::vector<Block*> reverse_post_order() const;
 
     std::deque<JoinNodeType> join_stack;
 
@@ -246,14 +299,28 @@ private:
     SymbolTableType symbol_table = { { FUNC_INPUT_NUM, { "read", std::nullopt } }, { FUNC_OUTPUT_NUM, { "write", std::nullopt } }, { FUNC_OUTPUT_NL, { "writeNL", std::nullopt } } };
     const u64 inbuilt_count = symbol_table.size();
 
-    std::unordered_map<Instr, u64> expressions;
+    ValueTable expressions;
     std::unordered_map<u64, u64> constants;
+    // value -> instructions that read it, kept while the ssa is built, entries
+    // go stale when an operand changes and are checked on use
+    std::vector<std::vector<u32>> uses;
 
-    void add_to_block(Instr instr);
-    Instr& add_to_block(Instr&& instr, std::shared_ptr<Block>& b);
+    u64 use_visits = 0; // readers replace_uses() went through
 
-    static u64 instruction_num;
-    std::shared_ptr<Block> blocks; // head
-    std::shared_ptr<Block> current;
+    void add_uses(const Instr& instr);
+    void replace_uses(u32 from, u32 to);
+
+    void add_to_block(Instr instr);
+    Instr& add_to_block(Instr&& instr, Block* b);
+
+    // owns every block and instruction of the function, blocks are never
+    // destroyed one by one, the arena drops all of them at once
+    std::pmr::monotonic_buffer_resource arena;
+    InstrPool pool { &arena };
+    u64 block_count = 0;
+    Block* blocks; // head
+    Block* current;
+    mutable std::optional<DominatorTree> dom_tree;
+    mutable std::optional<LoopNest> loop_nest;
     friend std::ostream& operator<<(std::ostream& os, const SSA& ssa);
 };
@@ -0,0 +1,228 @@
+#include <algorithm>
+
+#include "opt.h"
+
+// self call whose value is returned right away, or combined with a value
+// computed before the call by an associative operation first
+struct TailCall {
+    Block* b;
+    InstrList::iterator first; // first setp of the call
+    u64 jump;
+    std::optional<InstrType> op; // ADD or MUL of the accumulator
+    u64 operand;
+};
+
+static std::optional<TailCall> find_tail_call(Block* b, u64 self)
+{
+    auto& instrs = b->get_instructions();
+    for (auto it = instrs.begin(); it != instrs.end(); ++it) {
+        if (it->type != InstrType::JUMP || *it->x != self)
+            continue;
+        TailCall call = { b, it, it->pos, std::nullopt, 0 };
+        while (call.first != instrs.begin() && std::prev(call.first)->type == InstrType::SETP)
+            --call.first;
+
+        auto next = std::next(it);
+        if (next != instrs.end() && next->type == InstrType::RET && next->x == call.jump)
+            return call;
+
+        // return a + call f(..)
+        if (next == instrs.end() || (next->type != InstrType::ADD && next->type != InstrType::MUL))
+            continue;
+        auto ret = std::next(next);
+        if (ret == instrs.end() || ret->type != InstrType::RET || ret->x != next->pos || next->x == next->y)
+            continue;
+        if (next->x != call.jump && next->y != call.jump)
+            continue;
+        auto operand = next->x == call.jump ? next->y : next->x;
+        if (!operand)
+            continue;
+        call.op = next->type;
+        call.operand = *operand;
+        return call;
+    }
+    return std::nullopt;
+}
+
+// Turns the parameters into phis of a loop header right behind them and every
+// tail call into an edge to a latch block, the single back edge to the header.
+// With several calls the latch is a chain of join blocks whose phis merge the
+// arguments two at a time. With an accumulator the header gets one more phi
+// that starts at the identity of the operation, every other return combines it
+// with the returned value.
+static bool eliminate_tail_call(SSA& ssa, u64 self)
+{
+    Block* head = ssa.get_head();
+    Block* entry = head->left;
+    if (!entry || head->successors() != std::vector<Block*> { entry })
+        return false;
+
+    // the parameters stay in the entry, everything after them becomes the header
+    auto& params = entry->get_instructions();
+    auto split = params.begin();
+    for (auto it = params.begin(); it != params.end(); ++it)
+        if (it->type == InstrType::GETP)
+            split = std::next(it);
+    if (std::any_of(params.begin(), split, [](const Instr& instr) { return instr.type != InstrType::GETP && instr.type != InstrType::NONE; }))
+        return false;
+
+    auto order = ssa.reverse_post_order();
+    for (auto* b : order)
+        if (b->entry == entry)
+            return false;
+
+    if (std::none_of(order.begin(), order.end(), [&](Block* b) { return find_tail_call(b, self).has_value(); }))
+        return false;
+
+    // the header takes over the successors of the entry
+    Block* header = ssa.new_block();
+    for (auto it = split; it != params.end(); ++it)
+        header->add_back(std::move(*it));
+    params.erase(split, params.end());
+    for (auto* link : { &entry->left, &entry->right }) {
+        if (!*link)
+            continue;
+        for (auto* parent : { &(*link)->parent_left, &(*link)->parent_right })
+            if (*parent == entry)
+                *parent = header;
+    }
+    header->left = entry->left;
+    header->right = entry->right;
+    entry->right = nullptr;
+    entry->left = header;
+    header->parent_left = entry;
+
+    // calls combining with a different operation than the first one stay calls
+    std::vector<TailCall> calls;
+    std::optional<InstrType> op;
+    for (auto* b : ssa.reverse_post_order()) {
+        auto call = find_tail_call(b, self);
+        if (!call || (call->op && op && *call->op != *op))
+            continue;
+        if (call->op)
+            op = call->op;
+        calls.push_back(*call);
+    }
+
+    const auto phi = [&](Block* b, std::optional<u64> x, std::optional<u64> y) {
+        Instr instr = {};
+        instr.pos = ssa.next_pos();
+        instr.type = InstrType::PHI;
+        instr.x = x;
+        instr.y = y;
+        return b->add_front(std::move(instr)).pos;
+    };
+    const auto add = [&](Block* b, InstrList::iterator at, InstrType type, u64 x, std::optional<u64> y) {
+        Instr instr = {};
+        instr.pos = ssa.next_pos();
+        instr.type = type;
+        instr.x = x;
+        instr.y = y;
+        return b->get_instructions().insert(at, std::move(instr))->pos;
+    };
+
+    std::vector<u64> getps;
+    for (auto& instr : params)
+        if (instr.type == InstrType::GETP)
+            getps.push_back(instr.pos);
+
+    std::unordered_map<u64, u64> replace; // param -> phi
+    std::unordered_map<u64, size_t> phis; // header phi -> index of its value on the back edge
+    for (auto param : getps) {
+        u64 p = phi(header, param, std::nullopt);
+        replace[param] = p;
+        phis.emplace(p, phis.size());
+    }
+    std::optional<u64> acc;
+    if (op) {
+        acc = phi(header, get_const(ssa, *op == InstrType::ADD ? 0 : 1), std::nullopt);
+        phis.emplace(*acc, phis.size());
+    }
+
+    // the values each call hands to the next iteration, params in the order of
+    // getps then the accumulator
+    std::vector<std::pair<Block*, std::vector<u64>>> edges;
+    for (auto& call : calls) {
+        std::unordered_map<u64, u64> args; // param -> argument
+        for (auto it = call.first; it->pos != call.jump; ++it)
+            args[*it->y] = *it->x;
+
+        std::vector<u64> values;
+        for (auto& instr : params) {
+            if (instr.type != InstrType::GETP)
+                continue;
+            auto arg = args.find(*instr.y);
+            values.push_back(arg != args.end() ? arg->second : get_const(ssa, 0));
+        }
+
+        // the call and everything after its return go, the block continues to the latch
+        auto& instrs = call.b->get_instructions();
+        size_t first = call.first - instrs.begin();
+        if (acc) {
+            values.push_back(call.op ? add(call.b, instrs.begin() + first, *op, *acc, call.operand) : *acc);
+            first++;
+        }
+        instrs.erase(instrs.begin() + first, instrs.end());
+        for (auto* link : { &call.b->left, &call.b->right, &call.b->entry }) {
+            if (!*link)
+                continue;
+            for (auto* parent : { &(*link)->parent_left, &(*link)->parent_right })
+                if (*parent == call.b)
+                    *parent = nullptr;
+            *link = nullptr;
+        }
+        edges.emplace_back(call.b, std::move(values));
+    }
+
+    // every other return combines its value with the accumulator
+    if (acc) {
+        for (auto* b : ssa.reverse_post_order()) {
+            auto& rets = b->get_instructions();
+            for (size_t i = 0; i < rets.size(); i++) {
+                if (rets[i].type != InstrType::RET)
+                    continue;
+                u64 value = rets[i].x ? *rets[i].x : get_const(ssa, 0);
+                u64 combined = add(b, rets.begin() + i, *op, *acc, value);
+                rets[++i].x = combined;
+            }
+        }
+    }
+
+    // joins the edges pairwise, the values of both sides meet in phis
+    auto latch = edges.front();
+    for (size_t i = 1; i < edges.size(); i++) {
+        Block* join = ssa.new_block();
+        join->parent_left = latch.first;
+        join->parent_right = edges[i].first;
+        latch.first->right = join;
+        edges[i].first->left = join;
+        std::vector<u64> values;
+        for (size_t k = 0; k < latch.second.size(); k++)
+            values.push_back(latch.second[k] == edges[i].second[k] ? latch.second[k] : phi(join, latch.second[k], edges[i].second[k]));
+        latch = { join, std::move(values) };
+    }
+    latch.first->entry = header;
+
+    for (auto& instr : header->get_instructions())
+        if (phis.count(instr.pos))
+            instr.y = latch.second[phis.at(instr.pos)];
+
+    for (auto* b : ssa.reverse_post_order()) {
+        for (auto& instr : b->get_instructions()) {
+            if (instr.isValueX() && instr.x && replace.count(*instr.x) && !phis.count(instr.pos))
+                instr.x = replace.at(*instr.x);
+            if (instr.isValueY() && instr.y && replace.count(*instr.y))
+                instr.y = replace.at(*instr.y);
+        }
+    }
+    ssa.invalidate_cfg();
+    return true;
+}
+
+bool eliminate_tail_calls(std::deque<SSA>& ir, const FunctionMap& functions)
+{
+    bool changed = false;
+    for (auto& [_, f] : functions)
+        changed |= eliminate_tail_call(ir[f.index], f.pos);
+    return changed;
+}
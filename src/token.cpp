@@ -1,236 +1,551 @@
 #include "token.h"
 
+#include <algorithm>
 #include <cassert>
-#include <fstream>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
-Token::Token()
-    : _type(TokenType::UNKNOWN)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+Interner::Interner()
+    : names({ "InputNum", "OutputNum", "OutputNewLine" })
 {
+    grow();
 }
 
-Token::Token(TokenType type, std::optional<u64> val)
-    : _type(type)
-    , _val(val)
+// fnv-1a
+static inline u32 hash_name(std::string_view name)
 {
+    u32 h = 2166136261u;
+    for (char c : name)
+        h = (h ^ (u8)c) * 16777619u;
+    return h;
 }
 
-Token::Token(TokenType type, std::optional<u64> val, std::string&& id)
-    : _type(type)
-    , _val(val)
-    , _id(std::move(id))
+u32 Interner::intern(std::string_view name)
 {
+    u32 h = hash_name(name);
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    for (; slots[i].id; i = (i + 1) & mask)
+        if (slots[i].hash == h && names[slots[i].id - 1] == name)
+            return slots[i].id - 1;
+
+    u32 id = names.size();
+    names.push_back(name);
+    slots[i] = { id + 1, h };
+    if (names.size() * 2 > slots.size())
+        grow();
+    return id;
 }
 
-static u64 get_id(const std::string& id);
-bool TokenList::__tokenize(std::istream& is)
+void Interner::grow()
 {
-    assert(TOKEN_TYPE_COUNT == token_str.size());
-    bool ret = true;
+    slots.assign(std::max<size_t>(64, slots.size() * 2), { 0, 0 });
+    size_t mask = slots.size() - 1;
+    for (u32 id = 0; id < names.size(); id++) {
+        u32 h = hash_name(names[id]);
+        size_t i = h & mask;
+        while (slots[i].id)
+            i = (i + 1) & mask;
+        slots[i] = { id + 1, h };
+    }
+}
+
+// classes of the first character of a token, everything outside of ascii is OTHER
+enum CharClass : u8 {
+    OTHER,
+    SPACE,
+    DIGIT,
+    ALPHA,
+    SINGLE, // a token of its own, see CharTable::single
+    OPERATOR, // / = ! < >, decided by the next character
+};
+
+struct CharTable {
+    CharClass cls[256] = {};
+    TokenType single[256] = {};
+};
+
+static constexpr CharTable make_char_table()
+{
+    CharTable t;
+    for (size_t c = 0; c < 256; c++)
+        t.single[c] = TokenType::UNKNOWN;
+    for (const char* c = " \t\n\v\f\r"; *c; c++)
+        t.cls[(u8)*c] = SPACE;
+    for (char c = '0'; c <= '9'; c++)
+        t.cls[(u8)c] = DIGIT;
+    for (char c = 'a'; c <= 'z'; c++)
+        t.cls[(u8)c] = t.cls[(u8)(c - 'a' + 'A')] = ALPHA;
+    for (const char* c = "/=!<>"; *c; c++)
+        t.cls[(u8)*c] = OPERATOR;
+
+    const std::pair<char, TokenType> singles[] = {
+        { '+', TokenType::PLUS },
+        { '-', TokenType::MIN },
+        { '*', TokenType::MUL },
+        { '.', TokenType::PERIOD },
+        { ',', TokenType::COMMA },
+        { ';', TokenType::SEMI },
+        { '(', TokenType::LPAREN },
+        { ')', TokenType::RPAREN },
+        { '{', TokenType::LBRACE },
+        { '}', TokenType::RBRACE },
+    };
+    for (auto [c, type] : singles) {
+        t.cls[(u8)c] = SINGLE;
+        t.single[(u8)c] = type;
+    }
+    return t;
+}
+
+static constexpr CharTable char_table = make_char_table();
+
+struct Keyword {
+    std::string_view name;
+    TokenType type = TokenType::ID;
+};
+
+static constexpr Keyword keywords[] = {
+    { "main", TokenType::MAIN },
+    { "call", TokenType::CALL },
+    { "void", TokenType::VOID },
+    { "function", TokenType::FUNC },
+    { "return", TokenType::RET },
+    { "let", TokenType::LET },
+    { "var", TokenType::VAR },
+    { "if", TokenType::IF },
+    { "then", TokenType::THEN },
+    { "else", TokenType::ELSE },
+    { "fi", TokenType::FI },
+    { "while", TokenType::WHILE },
+    { "do", TokenType::DO },
+    { "od", TokenType::OD },
+};
+
+#define KEYWORD_SLOTS 32
+#define KEYWORD_MIN 2
+#define KEYWORD_MAX 8
 
-    char c;
-    while (is.get(c)) {
-        if (isspace(c))
-            continue;
+// perfect hash of the keywords over the first and last character and the length
+static constexpr u32 keyword_slot(const char* s, size_t len)
+{
+    return ((u8)s[0] * 2 + (u8)s[len - 1] * 19 + len) % KEYWORD_SLOTS;
+}
+
+struct KeywordTable {
+    Keyword slots[KEYWORD_SLOTS] = {};
+    bool perfect = true;
+};
+
+static constexpr KeywordTable make_keyword_table()
+{
+    KeywordTable t;
+    for (auto& k : keywords) {
+        auto& slot = t.slots[keyword_slot(k.name.data(), k.name.size())];
+        t.perfect &= slot.name.empty() && k.name.size() >= KEYWORD_MIN && k.name.size() <= KEYWORD_MAX;
+        slot = k;
+    }
+    return t;
+}
+
+static constexpr KeywordTable keyword_table = make_keyword_table();
+static_assert(keyword_table.perfect, "keywords share a slot, change the factors of keyword_slot()");
+
+// type of the keyword, ID for any other name
+static inline TokenType keyword(std::string_view id)
+{
+    if (id.size() < KEYWORD_MIN || id.size() > KEYWORD_MAX)
+        return TokenType::ID;
+    auto& k = keyword_table.slots[keyword_slot(id.data(), id.size())];
+    return k.name == id ? k.type : TokenType::ID;
+}
+
+static inline bool is_space(char c) { return char_table.cls[(u8)c] == SPACE; }
+static inline bool is_digit(char c) { return char_table.cls[(u8)c] == DIGIT; }
+static inline bool is_alnum(char c) { return char_table.cls[(u8)c] == DIGIT || char_table.cls[(u8)c] == ALPHA; }
+
+// The scans below return the first character at or after p that ends the run.
+// Most runs are a character or two, those stay with the table. Past the first
+// few characters sse2 tests 16 at once while that many are left.
+#define SCAN_SCALAR 8
+
+#if defined(__SSE2__)
+// lanes where lo <= c <= lo + n, compared unsigned through the minimum
+static inline __m128i in_range(__m128i c, char lo, char n)
+{
+    __m128i d = _mm_sub_epi8(c, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(n)), d);
+}
+
+template <typename Match>
+static inline const char* scan(const char* p, const char* end, Match match)
+{
+    for (; end - p >= 16; p += 16) {
+        u32 stop = ~_mm_movemask_epi8(match(_mm_loadu_si128((const __m128i*)p))) & 0xffff;
+        if (stop)
+            return p + __builtin_ctz(stop);
+    }
+    return p;
+}
+#endif
+
+static inline const char* skip_space(const char* p, const char* end)
+{
+    const char* scalar = std::min(end, p + SCAN_SCALAR);
+    while (p < scalar && is_space(*p))
+        p++;
+#if defined(__SSE2__)
+    if (p == scalar)
+        p = scan(p, end, [](__m128i c) { return _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), in_range(c, '\t', '\r' - '\t')); });
+#endif
+    while (p < end && is_space(*p))
+        p++;
+    return p;
+}
+
+static inline const char* skip_digits(const char* p, const char* end)
+{
+    const char* scalar = std::min(end, p + SCAN_SCALAR);
+    while (p < scalar && is_digit(*p))
+        p++;
+#if defined(__SSE2__)
+    if (p == scalar)
+        p = scan(p, end, [](__m128i c) { return in_range(c, '0', 9); });
+#endif
+    while (p < end && is_digit(*p))
+        p++;
+    return p;
+}
+
+static inline const char* skip_alnum(const char* p, const char* end)
+{
+    const char* scalar = std::min(end, p + SCAN_SCALAR);
+    while (p < scalar && is_alnum(*p))
+        p++;
+#if defined(__SSE2__)
+    // setting 0x20 folds upper case onto lower case
+    if (p == scalar)
+        p = scan(p, end, [](__m128i c) { return _mm_or_si128(in_range(c, '0', 9), in_range(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 25)); });
+#endif
+    while (p < end && is_alnum(*p))
+        p++;
+    return p;
+}
+
+// Lexes the next token behind p into tok and moves p past it. Returns false
+// once only space and comments are left, ok turns false on a character that
+// starts no token.
+inline bool TokenList::lex(const char*& p, const char* end, Token& tok, bool& ok)
+{
+    const auto next_is = [&](char c) { return p < end && *p == c; };
+
+    while ((p = skip_space(p, end)) < end) {
+        const char* start = p;
+        char c = *p++;
 
         TokenType type = TokenType::UNKNOWN;
-        std::optional<u64> val;
-        std::string id;
-        bool save_id = false;
-        switch (c) {
-        case '+':
-            type = TokenType::PLUS;
-            break;
-        case '-':
-            type = TokenType::MIN;
-            break;
-        case '*':
-            type = TokenType::MUL;
+        u32 payload = 0;
+        bool wide = false;
+        switch (char_table.cls[(u8)c]) {
+        case SINGLE:
+            type = char_table.single[(u8)c];
             break;
-        case '/':
-            if (is.peek() == '/') {
-                while (c != '\n') {
-                    is.get(c);
-                }
-                continue;
-            }
-            type = TokenType::DIV;
-            break;
-        case '.':
-            type = TokenType::PERIOD;
-            break;
-        case ',':
-            type = TokenType::COMMA;
-            break;
-        case ';':
-            type = TokenType::SEMI;
-            break;
-        case '(':
-            type = TokenType::LPAREN;
-            break;
-        case ')':
-            type = TokenType::RPAREN;
-            break;
-        case '{':
-            type = TokenType::LBRACE;
-            break;
-        case '}':
-            type = TokenType::RBRACE;
-            break;
-        case '=': {
-            if (is.peek() == '=') {
-                type = TokenType::EQ;
-                is.get();
-            }
-        } break;
-        case '!': {
-            if (is.peek() == '=') {
-                type = TokenType::NEQ;
-                is.get();
+        case DIGIT: {
+            p = skip_digits(p, end);
+            u64 num = 0;
+            for (const char* d = start; d < p; d++)
+                num = num * 10 + (*d - '0');
+            type = TokenType::NUM;
+            payload = num;
+            if (num > UINT32_MAX) {
+                payload = numbers.size();
+                numbers.push_back(num);
+                wide = true;
             }
         } break;
-        case '>': {
-            if (is.peek() == '=') {
-                type = TokenType::GTEQ;
-                is.get();
-            } else {
-                type = TokenType::GT;
-            }
-        } break;
-        case '<': {
-            if (is.peek() == '-') {
-                type = TokenType::ASSIGN;
-                is.get();
-            } else if (is.peek() == '=') {
-                type = TokenType::LTEQ;
-                is.get();
-            } else {
-                type = TokenType::LT;
-            }
+        case ALPHA: {
+            p = skip_alnum(p, end);
+            std::string_view id(start, p - start);
+            type = keyword(id);
+            if (type == TokenType::ID)
+                payload = interner.intern(id);
         } break;
-        default:
-            if (isdigit(c)) {
-                u64 num = c - '0';
-                while (isdigit(is.peek())) {
-                    is.get(c);
-                    num = num * 10 + (c - '0');
+        case OPERATOR:
+            switch (c) {
+            case '/':
+                if (next_is('/')) {
+                    auto nl = (const char*)std::memchr(p, '\n', end - p);
+                    p = nl ? nl : end;
+                    continue;
                 }
-                type = TokenType::NUM;
-                val = num;
+                type = TokenType::DIV;
                 break;
-            } else if (isalpha(c)) {
-                id += c;
-                while (isalnum(is.peek())) {
-                    is.get(c);
-                    id += c;
+            case '=':
+                if (next_is('=')) {
+                    type = TokenType::EQ;
+                    p++;
                 }
-
-                if (id == "main") {
-                    type = TokenType::MAIN;
-                } else if (id == "call") {
-                    type = TokenType::CALL;
-                } else if (id == "void") {
-                    type = TokenType::VOID;
-                } else if (id == "function") {
-                    type = TokenType::FUNC;
-                } else if (id == "return") {
-                    type = TokenType::RET;
-                } else if (id == "let") {
-                    type = TokenType::LET;
-                } else if (id == "var") {
-                    type = TokenType::VAR;
-                } else if (id == "if") {
-                    type = TokenType::IF;
-                } else if (id == "then") {
-                    type = TokenType::THEN;
-                } else if (id == "else") {
-                    type = TokenType::ELSE;
-                } else if (id == "fi") {
-                    type = TokenType::FI;
-                } else if (id == "while") {
-                    type = TokenType::WHILE;
-                } else if (id == "do") {
-                    type = TokenType::DO;
-                } else if (id == "od") {
-                    type = TokenType::OD;
-                } else { // NOTE: is an identifier
-                    type = TokenType::ID;
-                    val = get_id(id);
-                    save_id = true;
+                break;
+            case '!':
+                if (next_is('=')) {
+                    type = TokenType::NEQ;
+                    p++;
+                }
+                break;
+            case '>':
+                type = TokenType::GT;
+                if (next_is('=')) {
+                    type = TokenType::GTEQ;
+                    p++;
+                }
+                break;
+            case '<':
+                type = TokenType::LT;
+                if (next_is('-')) {
+                    type = TokenType::ASSIGN;
+                    p++;
+                } else if (next_is('=')) {
+                    type = TokenType::LTEQ;
+                    p++;
                 }
-            } else {
-                do {
-                    id += c;
-                    c = is.peek();
-                } while (!isspace(c) && c != EOF && is.get());
-
-                type = TokenType::UNKNOWN;
-                save_id = true;
-                ret = false;
+                break;
             }
+            break;
+        case SPACE:
+        case OTHER:
+            while (p < end && !is_space(*p))
+                p++;
+            payload = interner.intern({ start, (size_t)(p - start) });
+            ok = false;
+            break;
         }
 
-        if (save_id)
-            toks.emplace_back(type, val, std::move(id));
-        else
-            toks.emplace_back(type, val);
+        tok = Token(type, payload, wide);
+        return true;
     }
+    return false;
+}
+
+bool TokenList::__tokenize(std::string_view source)
+{
+    assert(TOKEN_TYPE_COUNT == token_str.size());
+    bool ret = true;
 
+    // a token takes at least two characters in any real program, one and its separator
+    toks.reserve(toks.size() + source.size() / 2);
+
+    const char* p = source.data();
+    const char* end = p + source.size();
+    Token tok;
+    while (lex(p, end, tok, ret))
+        toks.push_back(tok);
     return ret;
 }
 
-bool TokenList::tokenize(std::filesystem::path file)
+// First place at or after p to split the source at, a space outside of a
+// comment. There are no strings, any // between the start of the line and p
+// opens a comment that runs to the newline.
+static const char* split_point(const char* begin, const char* p, const char* end)
 {
-    std::ifstream f;
+    p = std::find_if(p, end, is_space);
+    if (p == end)
+        return end;
+    const char* line = (const char*)memrchr(begin, '\n', p - begin);
+    line = line ? line + 1 : begin;
+    if (std::string_view(line, p - line).find("//") == std::string_view::npos)
+        return p;
+    // inside a comment, it ends with the line
+    return std::find(p, end, '\n');
+}
 
-    f.open(file.c_str(), std::ifstream::in);
+// Every chunk is lexed into a list of its own on a thread. Their names are
+// interned again in chunk order, which numbers them in order of appearance
+// just like one pass over the whole source. Copying the tokens into place
+// with their new ids runs on the threads as well.
+bool TokenList::__tokenize(std::string_view source, unsigned jobs)
+{
+    jobs = std::min<size_t>(jobs, source.size() / TOKENIZE_CHUNK);
+    if (jobs <= 1)
+        return __tokenize(source);
 
-    if (f.fail()) {
-        f.close();
-        return false;
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    std::vector<std::string_view> chunks;
+    for (const char* p = begin; p < end;) {
+        size_t left = end - p, size = left / (jobs - chunks.size());
+        const char* split = chunks.size() + 1 < jobs ? split_point(begin, p + size, end) : end;
+        chunks.emplace_back(p, split - p);
+        p = split;
     }
 
-    bool res = __tokenize(f);
+    std::vector<TokenList> parts(chunks.size());
+    std::vector<char> ok(chunks.size());
+    const auto run = [&](auto&& work) {
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < chunks.size(); i++)
+            threads.emplace_back(work, i);
+        work(0);
+        for (auto& t : threads)
+            t.join();
+    };
+    run([&](size_t i) { ok[i] = parts[i].__tokenize(chunks[i]); });
 
-    f.close();
-    return res;
+    // ids and wide numbers of every part in the numbering of the list
+    std::vector<std::vector<u32>> ids(parts.size());
+    std::vector<u32> number_base(parts.size());
+    std::vector<size_t> offset(parts.size());
+    size_t count = toks.size();
+    for (size_t i = 0; i < parts.size(); i++) {
+        auto& names = parts[i].interner;
+        ids[i].resize(names.size());
+        for (u32 id = 0; id < names.size(); id++)
+            ids[i][id] = interner.intern(names.name(id));
+        number_base[i] = numbers.size();
+        numbers.insert(numbers.end(), parts[i].numbers.begin(), parts[i].numbers.end());
+        offset[i] = count;
+        count += parts[i].toks.size();
+    }
+
+    toks.resize(count);
+    run([&](size_t i) {
+        Token* out = &toks[offset[i]];
+        for (Token tok : parts[i].toks) {
+            if (tok._wide)
+                tok._payload += number_base[i];
+            else if (tok.type() == TokenType::ID || tok.type() == TokenType::UNKNOWN)
+                tok._payload = ids[i][tok._payload];
+            *out++ = tok;
+        }
+    });
+    return std::all_of(ok.begin(), ok.end(), [](char c) { return c; });
+}
+
+void TokenList::refill()
+{
+    bool ok = true;
+    for (; ahead < TOKEN_LOOKAHEAD; ahead++) {
+        if (!lex(cursor, limit, ring[(index + ahead) % TOKEN_LOOKAHEAD], ok))
+            break;
+        lexed++;
+    }
+}
+
+std::optional<std::string_view> TokenList::map(const std::filesystem::path& file)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return std::nullopt;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    // an empty file can not be mapped and has no tokens
+    size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        return std::string_view();
+    }
+    void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return std::nullopt;
+    madvise(p, size, MADV_SEQUENTIAL);
+    sources.emplace_back((const char*)p, [size](const char* mapped) { munmap((void*)mapped, size); });
+    return std::string_view((const char*)p, size);
+}
+
+bool TokenList::tokenize(std::filesystem::path file, unsigned jobs)
+{
+    auto source = map(file);
+    return source && __tokenize(*source, jobs);
 }
 
 bool TokenList::tokenize(const std::string& str)
 {
-    std::stringstream ss(str);
+    char* copy = new char[str.size()];
+    std::memcpy(copy, str.data(), str.size());
+    sources.emplace_back(copy, std::default_delete<char[]>());
 
-    return __tokenize(ss);
+    return __tokenize({ copy, str.size() });
 }
 
-void TokenList::show()
+bool TokenList::tokenize_view(std::string_view source, unsigned jobs)
 {
-    uint32_t i = 0;
-    std::cerr << '[';
-    for (const auto& e : toks) {
-        std::cerr << e;
-        if (++i != toks.size())
-            std::cerr << ", ";
-    }
-    std::cerr << "]\n";
+    return __tokenize(source, jobs);
 }
 
-static u64 get_id(const std::string& id)
+bool TokenList::stream(std::filesystem::path file)
 {
-    static u64 __func_id = 0;
-    static std::unordered_map<std::string, u64> __func_map = { { "InputNum", __func_id++ }, { "OutputNum", __func_id++ }, { "OutputNewLine", __func_id++ } };
+    auto source = map(file);
+    if (!source)
+        return false;
+    stream_view(*source);
+    return true;
+}
 
-    if (__func_map.find(id) != __func_map.end()) {
-        return __func_map.at(id);
-    }
+void TokenList::stream_view(std::string_view source)
+{
+    assert(!streaming && toks.empty());
+    streaming = true;
+    cursor = source.data();
+    limit = source.data() + source.size();
+    refill();
+}
+
+TokenList TokenList::slice(size_t begin, size_t end) const
+{
+    assert(!streaming && begin <= end && end <= toks.size());
+    TokenList list;
+    list.parent = parent ? parent : this;
+    list.toks.assign(toks.begin() + begin, toks.begin() + end);
+    return list;
+}
 
-    __func_map[id] = __func_id;
-    return __func_id++;
+std::optional<u64> TokenList::val(const Token& tok) const
+{
+    if (parent)
+        return parent->val(tok);
+    switch (tok.type()) {
+    case TokenType::ID:
+        return tok._payload;
+    case TokenType::NUM:
+        return tok._wide ? numbers[tok._payload] : tok._payload;
+    default:
+        break;
+    }
+    return std::nullopt;
 }
 
-std::ostream& operator<<(std::ostream& os, const Token& tok)
+std::string_view TokenList::id(const Token& tok) const
 {
-    __PRTOK(os, tok);
+    if (parent)
+        return parent->id(tok);
+    // a lone = or ! is unknown without text, payload 0 is a builtin
+    if (tok.type() == TokenType::ID || (tok.type() == TokenType::UNKNOWN && tok._payload))
+        return interner.name(tok._payload);
+    return {};
+}
 
-    return os;
+void TokenList::show()
+{
+    uint32_t i = 0;
+    std::cerr << '[';
+    for (const auto& e : toks) {
+        __PRTOK(std::cerr, *this, e);
+        if (++i != toks.size())
+            std::cerr << ", ";
+    }
+    std::cerr << "]\n";
 }
@@ -1,35 +1,25 @@
 #pragma once
 
+#include <array>
 #include <filesystem>
 
-#define __PRTOK(os, tok)                         \
-    do {                                         \
-        os << token_str[(u64)(tok).type()];      \
-        if ((tok).val())                         \
-            os << " " << *(tok).val();           \
-        if (!(tok).id().empty())                 \
-            os << " (\"" << (tok).id() << "\")"; \
+#define __PRTOK(os, toks, tok)                          \
+    do {                                                \
+        os << token_str[(u64)(tok).type()];             \
+        if ((toks).val(tok))                            \
+            os << " " << *(toks).val(tok);              \
+        if (!(toks).id(tok).empty())                    \
+            os << " (\"" << (toks).id(tok) << "\")"; \
     } while (0)
 
-#define PRTOK(tok) __PRTOK(std::cerr, (tok))
-#define PRTOKLN(tok)     \
-    do {                 \
-        PRTOK((tok));    \
-        LOG_ERROR("\n"); \
+#define PRTOK(toks, tok) __PRTOK(std::cerr, (toks), (tok))
+#define PRTOKLN(toks, tok)    \
+    do {                      \
+        PRTOK((toks), (tok)); \
+        LOG_ERROR("\n");      \
     } while (0)
 
-#define PRINT_TOKENS(os, toks)                     \
-    do {                                           \
-        for (size_t i = 0; i < toks.size(); i++) { \
-            const auto& e = toks[i];               \
-            os << e;                               \
-            if (i != toks.size() - 1)              \
-                os << ", ";                        \
-        }                                          \
-        os << "\n";                                \
-    } while (0)
-
-enum class TokenType {
+enum class TokenType : u8 {
     // KEYWORDS
     MAIN,
     CALL,
@@ -127,56 +117,142 @@ const std::vector<std::string> token_str = {
 
 #define TOKEN_TYPE_COUNT ((u64)TokenType::MAX_TOKEN_TYPE)
 
-enum class TokenType;
+// Names of one compilation, numbered in order of appearance after the
+// builtins InputNum, OutputNum and OutputNewLine. The names are not copied, they
+// have to outlive the interner.
+class Interner {
+public:
+    Interner();
+
+    u32 intern(std::string_view name);
+    inline std::string_view name(u32 id) const { return names[id]; }
+    inline size_t size() const { return names.size(); }
+
+private:
+    // open addressing with linear probing on the hash of the name, at most half
+    // full, a slot holds the id + 1 and 0 when empty
+    struct Slot {
+        u32 id;
+        u32 hash;
+    };
+    std::vector<Slot> slots;
+    std::vector<std::string_view> names;
+
+    void grow();
+};
 
+// 8 bytes, the payload is the id of a name in the interner of the list or the
+// value of a number. Numbers past 32 bits are wide, their payload indexes the
+// numbers of the list. Values and names are read through the TokenList.
 class Token {
     TokenType _type;
-    std::optional<u64> _val;
-    std::string _id;
+    bool _wide;
+    u32 _payload;
 
-public:
-    Token();
-    Token(TokenType type, std::optional<u64> val);
-    Token(TokenType type, std::optional<u64> val, std::string&& id);
+    friend class TokenList;
 
-    TokenType type() const { return this->_type; }
-    inline std::optional<u64> val() const { return this->_val; }
-    const std::string& id() const { return this->_id; }
+public:
+    Token(TokenType type = TokenType::UNKNOWN, u32 payload = 0, bool wide = false)
+        : _type(type)
+        , _wide(wide)
+        , _payload(payload)
+    {
+    }
 
-    friend std::ostream& operator<<(std::ostream& os, const Token& tok);
+    inline TokenType type() const { return this->_type; }
 };
 
+static_assert(sizeof(Token) == 8);
+
+// tokens lexed ahead of the parser when streaming
+#define TOKEN_LOOKAHEAD 64
+// smallest piece of the source a thread lexes on its own
+#define TOKENIZE_CHUNK (1 << 20)
+
 class TokenList {
+    // mapped files and copied strings the names point into, copies of the
+    // list share them
+    std::vector<std::shared_ptr<const char>> sources;
+    Interner interner;
+    std::vector<u64> numbers; // wide numbers
+
     std::vector<Token> toks;
     uint64_t index = 0;
 
+    // set on slices, their names and numbers are those of the list
+    const TokenList* parent = nullptr;
+
+    // when streaming the tokens are lexed on demand into a ring, toks stays empty
+    bool streaming = false;
+    const char* cursor = nullptr;
+    const char* limit = nullptr;
+    std::array<Token, TOKEN_LOOKAHEAD> ring;
+    size_t ahead = 0; // lexed but not eaten
+    size_t lexed = 0;
+
 public:
-    bool tokenize(std::filesystem::path file);
+    // The file is mapped and the names point into it. With more than one job
+    // large sources are cut into chunks lexed on that many threads, the tokens
+    // and ids come out the same.
+    bool tokenize(std::filesystem::path file, unsigned jobs = 1);
     bool tokenize(const std::string& str);
+    // tokenizes the buffer in place, it has to outlive the list
+    bool tokenize_view(std::string_view source, unsigned jobs = 1);
+    // like the above but the tokens are only lexed as they are eaten, a
+    // character that starts no token turns up as an UNKNOWN token
+    bool stream(std::filesystem::path file);
+    void stream_view(std::string_view source);
     void show();
-    inline size_t size() const { return toks.size(); }
-    inline size_t remaining() const { return toks.size() - index; }
+    // tokens lexed so far and those not eaten yet
+    inline size_t size() const { return streaming ? lexed : toks.size(); }
+    inline size_t remaining() const { return streaming ? ahead : toks.size() - index; }
 
     inline TokenType get_type() const
     {
-        if (index < toks.size())
-            return toks[index].type();
-        return TokenType::UNKNOWN;
+        const Token* tok = get();
+        return tok ? tok->type() : TokenType::UNKNOWN;
     }
 
     inline const Token* get() const
     {
+        if (streaming)
+            return ahead ? &ring[index % TOKEN_LOOKAHEAD] : nullptr;
         if (index < toks.size())
             return &toks[index];
         return nullptr;
     }
 
-    void eat() { index++; }
+    // a token from get() is only valid until the next eat() when streaming
+    inline void eat()
+    {
+        index++;
+        if (streaming && ahead && !--ahead)
+            refill();
+    }
+
+    // id of a name or the value of a number
+    std::optional<u64> val(const Token& tok) const;
+    // text of a name or unknown token, empty for anything else
+    std::string_view id(const Token& tok) const;
+    // of the current token
+    inline std::optional<u64> val() const { return get() ? val(*get()) : std::nullopt; }
+    inline std::string_view id() const { return get() ? id(*get()) : std::string_view(); }
+
+    inline const Interner& names() const { return parent ? parent->interner : interner; }
+
+    // Random access for lists that are not streaming. A slice holds the tokens
+    // [begin, end) with a position of its own, it reads names and numbers from
+    // this list, which has to outlive it.
+    inline bool is_streaming() const { return streaming; }
+    inline size_t position() const { return index; }
+    inline void seek(size_t i) { index = i; }
+    inline const Token& at(size_t i) const { return toks[i]; }
+    TokenList slice(size_t begin, size_t end) const;
 
-    // std::optional<const Token*> get() const {
-    //     if (index >= toks.size()) return {};
-    //     return &toks[index];
-    // }
 private:
-    bool __tokenize(std::istream& os);
+    std::optional<std::string_view> map(const std::filesystem::path& file);
+    bool lex(const char*& p, const char* end, Token& tok, bool& ok);
+    bool __tokenize(std::string_view source);
+    bool __tokenize(std::string_view source, unsigned jobs);
+    void refill();
 };
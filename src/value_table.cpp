@@ -0,0 +1,105 @@
+#include "value_table.h"
+
+ValueTable::Slot ValueTable::key(const Instr& instr)
+{
+    Slot k;
+    k.type = instr.type;
+    k.x = instr.x.id;
+    k.y = instr.y.id;
+    if (isCommutative(instr.type) && k.y < k.x)
+        std::swap(k.x, k.y);
+    return k;
+}
+
+// operands keep their place in the key, the finalizer of murmur3 spreads it
+u64 ValueTable::hash(const Slot& key)
+{
+    u64 h = ((u64)key.x << 32 | key.y) ^ ((u64)key.type * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+size_t ValueTable::probe(const Slot& key) const
+{
+    size_t mask = slots.size() - 1;
+    size_t i = hash(key) & mask;
+    while (slots[i].value != ValueId::NONE && !slots[i].same_key(key))
+        i = (i + 1) & mask;
+    return i;
+}
+
+std::optional<u32> ValueTable::find(const Instr& instr) const
+{
+    if (slots.empty())
+        return std::nullopt;
+    auto& slot = slots[probe(key(instr))];
+    if (slot.value == ValueId::NONE)
+        return std::nullopt;
+    return slot.value;
+}
+
+void ValueTable::insert(const Instr& instr, u32 value)
+{
+    assert(value != ValueId::NONE);
+    if ((count + 1) * 2 > slots.size())
+        grow();
+
+    Slot k = key(instr);
+    auto& slot = slots[probe(k)];
+    u32 previous = slot.value;
+    if (previous == ValueId::NONE) {
+        slot = k;
+        count++;
+    }
+    slot.value = value;
+    // outside of any scope nothing is ever undone
+    if (!scopes.empty())
+        undo.push_back({ k, previous });
+}
+
+void ValueTable::pop_scope()
+{
+    assert(!scopes.empty());
+    size_t mark = scopes.back();
+    scopes.pop_back();
+    while (undo.size() > mark) {
+        auto& [k, previous] = undo.back();
+        size_t i = probe(k);
+        assert(slots[i].value != ValueId::NONE);
+        if (previous != ValueId::NONE)
+            slots[i].value = previous;
+        else
+            erase(i);
+        undo.pop_back();
+    }
+}
+
+// backward shift deletion, later entries of the cluster move up into the hole
+// unless that would put them in front of their home slot
+void ValueTable::erase(size_t i)
+{
+    size_t mask = slots.size() - 1;
+    slots[i].value = ValueId::NONE;
+    count--;
+    for (size_t j = (i + 1) & mask; slots[j].value != ValueId::NONE; j = (j + 1) & mask) {
+        size_t home = hash(slots[j]) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            slots[j].value = ValueId::NONE;
+            i = j;
+        }
+    }
+}
+
+void ValueTable::grow()
+{
+    std::vector<Slot> old(std::max<size_t>(16, slots.size() * 2));
+    std::swap(slots, old);
+    for (auto& slot : old)
+        if (slot.value != ValueId::NONE)
+            slots[probe(slot)] = slot;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "instr.h"
+
+// Hash consing of expressions for value numbering, maps an opcode and its
+// operands to the value that computed them. Operands of commutative opcodes are
+// put in order so a + b and b + a meet, a - b and b - a never do. Inserts made
+// after push_scope() are undone by the matching pop_scope().
+class ValueTable {
+public:
+    std::optional<u32> find(const Instr& instr) const;
+    // an expression that is already known is shadowed until the scope ends
+    void insert(const Instr& instr, u32 value);
+
+    inline void push_scope() { scopes.push_back(undo.size()); }
+    void pop_scope();
+
+    inline size_t size() const { return count; }
+
+private:
+    // open addressing with linear probing, the table is at most half full
+    struct Slot {
+        u32 value = ValueId::NONE; // NONE marks an empty slot
+        InstrType type = InstrType::NONE;
+        u32 x = ValueId::NONE, y = ValueId::NONE;
+
+        inline bool same_key(const Slot& other) const { return type == other.type && x == other.x && y == other.y; }
+    };
+    struct Undo {
+        Slot key;
+        u32 previous; // value before the insert, NONE if it was new
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+    std::vector<Undo> undo;
+    std::vector<size_t> scopes; // size of undo when the scope was entered
+
+    static Slot key(const Instr& instr);
+    static u64 hash(const Slot& key);
+    // slot holding key, or the empty slot it would go into
+    size_t probe(const Slot& key) const;
+    void erase(size_t i);
+    void grow();
+};
@@ -0,0 +1,454 @@
+#include "vm.h"
+#include "parallel_move.h"
+
+#include <algorithm>
+
+#if defined(__GNUC__)
+#define VM_THREADED 1
+#endif
+
+#define VM_STACK_INITIAL (1 << 16)
+#define VM_STACK_MAX (1 << 25)
+
+VM::VM(const std::deque<SSA>& ir, const FunctionMap& functionMap)
+    : consts { 0 }
+{
+    auto jump_to_func = function_indices(functionMap);
+
+    functions.resize(ir.size());
+    for (size_t i = 0; i < ir.size(); i++) {
+        functions[i].name = ir[i].name;
+        lower(ir[i], jump_to_func, functions[i]);
+    }
+}
+
+static Op branch_op(InstrType type)
+{
+    switch (type) {
+    case InstrType::BNE:
+        return Op::JNE;
+    case InstrType::BEQ:
+        return Op::JEQ;
+    case InstrType::BLE:
+        return Op::JLE;
+    case InstrType::BLT:
+        return Op::JLT;
+    case InstrType::BGE:
+        return Op::JGE;
+    case InstrType::BGT:
+        return Op::JGT;
+    default:
+        break;
+    }
+    throw std::runtime_error("not a branch");
+}
+
+// lowers ssa into code, phis become parallel moves on the incoming edges
+void VM::lower(const SSA& ssa, const std::unordered_map<u64, u32>& jump_to_func, Function& func)
+{
+    auto order = ssa.reverse_post_order();
+
+    // frame layout: params | values | zero | tmp | outgoing params
+    std::unordered_map<u64, u32> slots;
+    std::unordered_map<u64, const Instr*> defs;
+    u32 params = 0;
+    u32 outgoing = 0;
+    for (auto* b : order) {
+        for (auto& instr : b->get_instructions()) {
+            defs[instr.pos] = &instr;
+            if (instr.type == InstrType::GETP) {
+                slots[instr.pos] = *instr.y - 1;
+                params = std::max<u32>(params, *instr.y);
+            } else if (instr.type == InstrType::SETP) {
+                outgoing = std::max<u32>(outgoing, *instr.y);
+            }
+        }
+    }
+    u32 next_slot = params;
+    for (auto* b : order)
+        for (auto& instr : b->get_instructions())
+            if (instr.hasValue() && instr.type != InstrType::GETP)
+                slots[instr.pos] = next_slot++;
+    const u32 zero = next_slot++;
+    const u32 tmp = next_slot++;
+    const u32 base = next_slot;
+    func.frame_size = base + outgoing;
+
+    // missing values (uninitialized phi operands, void returns) read as zero
+    const auto slot = [&](std::optional<u64> pos) -> u32 {
+        if (!pos)
+            return zero;
+        auto it = slots.find(*pos);
+        return it == slots.end() ? zero : it->second;
+    };
+
+    // cmp results only need a slot when used outside of a branch
+    std::unordered_set<u64> cmp_used;
+    for (auto* b : order)
+        for (auto& instr : b->get_instructions())
+            if (!isBranch(instr.type) && instr.isValueX() && instr.x)
+                cmp_used.insert(*instr.x);
+
+    const auto emit = [&](Op op, u32 a = 0, u32 b = 0, u32 c = 0) {
+        code.push_back({ op, a, b, c });
+        return code.size() - 1;
+    };
+
+    const auto emit_moves = [&](std::vector<std::pair<u32, u32>> moves) {
+        emit_parallel_moves(std::move(moves), tmp, [&](u32 dst, u32 src) { emit(Op::MOV, dst, src); });
+    };
+
+    const auto phi_moves = [&](Block* from, Block* to) {
+        std::vector<std::pair<u32, u32>> moves;
+        bool y = to->is_phi_y(from);
+        for (auto& instr : to->get_instructions())
+            if (instr.type == InstrType::PHI)
+                moves.emplace_back(slot(instr.pos), slot(y ? instr.y : instr.x));
+        return moves;
+    };
+
+    std::unordered_map<Block*, u32> starts;
+    std::vector<std::pair<u64, Block*>> fixups; // code index -> target block, patched into c for branches and a for jumps
+    std::vector<std::pair<u64, std::pair<Block*, Block*>>> trampolines;
+
+    func.entry = code.size();
+    emit(Op::LOADK, zero, 0);
+
+    for (size_t i = 0; i < order.size(); i++) {
+        Block* b = order[i];
+        Block* next = i + 1 < order.size() ? order[i + 1] : nullptr;
+        starts[b] = code.size();
+
+        bool returned = false;
+        const Instr* branch = nullptr;
+        for (auto& instr : b->get_instructions()) {
+            switch (instr.type) {
+            case InstrType::CONST: {
+                auto k = std::find(consts.begin(), consts.end(), instr.literal());
+                if (k == consts.end())
+                    k = consts.insert(consts.end(), instr.literal());
+                emit(Op::LOADK, slot(instr.pos), k - consts.begin());
+            } break;
+            case InstrType::ADD:
+                emit(Op::ADD, slot(instr.pos), slot(instr.x), slot(instr.y));
+                break;
+            case InstrType::SUB:
+                emit(Op::SUB, slot(instr.pos), slot(instr.x), slot(instr.y));
+                break;
+            case InstrType::MUL:
+                emit(Op::MUL, slot(instr.pos), slot(instr.x), slot(instr.y));
+                break;
+            case InstrType::DIV:
+                emit(Op::DIV, slot(instr.pos), slot(instr.x), slot(instr.y));
+                break;
+            case InstrType::CMP:
+                if (cmp_used.count(instr.pos))
+                    emit(Op::CMP, slot(instr.pos), slot(instr.x), slot(instr.y));
+                break;
+            case InstrType::BNE:
+            case InstrType::BEQ:
+            case InstrType::BLE:
+            case InstrType::BLT:
+            case InstrType::BGE:
+            case InstrType::BGT:
+                branch = &instr;
+                break;
+            case InstrType::READ:
+                emit(Op::READ, slot(instr.pos));
+                break;
+            case InstrType::WRITE:
+                emit(Op::WRITE, slot(instr.x));
+                break;
+            case InstrType::WRITENL:
+                emit(Op::WRITENL);
+                break;
+            case InstrType::SETP:
+                emit(Op::MOV, base + *instr.y - 1, slot(instr.x));
+                break;
+            case InstrType::JUMP: {
+                auto f = jump_to_func.find(*instr.x);
+                if (f == jump_to_func.end())
+                    throw std::runtime_error("jump to unknown function " + std::to_string(*instr.x));
+                emit(Op::CALL, slot(instr.pos), f->second, base);
+            } break;
+            case InstrType::RET:
+                emit(Op::RET, slot(instr.x));
+                returned = true;
+                break;
+            default: // PHI, GETP, BRA and NONE produce no code
+                break;
+            }
+            if (returned)
+                break;
+        }
+        if (returned)
+            continue;
+
+        auto succ = b->successors();
+        if (branch) {
+            Block* fall = succ[0];
+            Block* taken = succ[1];
+
+            // compare the cmp operands directly, falling back to comparing against zero
+            u32 lhs = slot(branch->x), rhs = zero;
+            auto cmp = defs.find(*branch->x);
+            if (cmp != defs.end() && cmp->second->type == InstrType::CMP) {
+                lhs = slot(cmp->second->x);
+                rhs = slot(cmp->second->y);
+            }
+            auto idx = emit(branch_op(branch->type), lhs, rhs);
+            if (phi_moves(b, taken).empty())
+                fixups.emplace_back(idx, taken);
+            else
+                trampolines.emplace_back(idx, std::make_pair(b, taken));
+
+            emit_moves(phi_moves(b, fall));
+            if (fall != next)
+                fixups.emplace_back(emit(Op::JMP), fall);
+        } else if (!succ.empty()) {
+            emit_moves(phi_moves(b, succ[0]));
+            if (succ[0] != next)
+                fixups.emplace_back(emit(Op::JMP), succ[0]);
+        } else if (&func == &functions[0]) {
+            emit(Op::HALT);
+        } else {
+            emit(Op::RET, zero);
+        }
+    }
+
+    // conditional edges into blocks with phis get their own move block
+    for (auto& [idx, edge] : trampolines) {
+        code[idx].c = code.size();
+        emit_moves(phi_moves(edge.first, edge.second));
+        fixups.emplace_back(emit(Op::JMP), edge.second);
+    }
+
+    for (auto& [idx, target] : fixups) {
+        if (code[idx].op == Op::JMP)
+            code[idx].a = starts.at(target);
+        else
+            code[idx].c = starts.at(target);
+    }
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+void VM::run(std::istream& in, std::ostream& out)
+{
+    const Code* const base = code.data();
+    const Code* pc = base + functions[0].entry;
+    const i64* const k = consts.data();
+
+    stack.assign(std::max<size_t>(VM_STACK_INITIAL, functions[0].frame_size), 0);
+    frames.clear();
+    frames.reserve(1024);
+    size_t fp = 0;
+    i64* r = stack.data();
+
+#ifdef VM_THREADED
+    static const void* const dispatch[] = {
+        &&op_LOADK, &&op_MOV, &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_CMP,
+        &&op_JMP, &&op_JNE, &&op_JEQ, &&op_JLE, &&op_JLT, &&op_JGE, &&op_JGT,
+        &&op_READ, &&op_WRITE, &&op_WRITENL, &&op_CALL, &&op_RET, &&op_HALT
+    };
+    static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == (size_t)Op::HALT + 1);
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() goto* dispatch[(u8)(++pc)->op]
+#define VM_JUMP(target)                \
+    do {                               \
+        pc = base + (target);          \
+        goto* dispatch[(u8)pc->op];    \
+    } while (0)
+    goto* dispatch[(u8)pc->op];
+#else
+#define VM_CASE(name) case Op::name:
+#define VM_NEXT() \
+    {             \
+        ++pc;     \
+        continue; \
+    }
+#define VM_JUMP(target)       \
+    {                         \
+        pc = base + (target); \
+        continue;             \
+    }
+    for (;;) {
+        switch (pc->op) {
+#endif
+
+#define VM_BRANCH(name, cond)        \
+    VM_CASE(name)                    \
+    {                                \
+        i64 a = r[pc->a];            \
+        i64 b = r[pc->b];            \
+        if (cond)                    \
+            VM_JUMP(pc->c);          \
+        VM_NEXT();                   \
+    }
+
+    VM_CASE(LOADK)
+    {
+        r[pc->a] = k[pc->b];
+        VM_NEXT();
+    }
+    VM_CASE(MOV)
+    {
+        r[pc->a] = r[pc->b];
+        VM_NEXT();
+    }
+    VM_CASE(ADD)
+    {
+        r[pc->a] = (i64)((u64)r[pc->b] + (u64)r[pc->c]);
+        VM_NEXT();
+    }
+    VM_CASE(SUB)
+    {
+        r[pc->a] = (i64)((u64)r[pc->b] - (u64)r[pc->c]);
+        VM_NEXT();
+    }
+    VM_CASE(MUL)
+    {
+        r[pc->a] = (i64)((u64)r[pc->b] * (u64)r[pc->c]);
+        VM_NEXT();
+    }
+    VM_CASE(DIV)
+    {
+        i64 a = r[pc->b];
+        i64 b = r[pc->c];
+        if (b == 0)
+            throw std::runtime_error("division by zero");
+        r[pc->a] = (b == -1) ? (i64)(0 - (u64)a) : a / b;
+        VM_NEXT();
+    }
+    VM_CASE(CMP)
+    {
+        i64 a = r[pc->b];
+        i64 b = r[pc->c];
+        r[pc->a] = (a > b) - (a < b);
+        VM_NEXT();
+    }
+    VM_CASE(JMP)
+    {
+        VM_JUMP(pc->a);
+    }
+    VM_BRANCH(JNE, a != b)
+    VM_BRANCH(JEQ, a == b)
+    VM_BRANCH(JLE, a <= b)
+    VM_BRANCH(JLT, a < b)
+    VM_BRANCH(JGE, a >= b)
+    VM_BRANCH(JGT, a > b)
+    VM_CASE(READ)
+    {
+        i64 v;
+        if (!(in >> v))
+            throw std::runtime_error("failed to read input");
+        r[pc->a] = v;
+        VM_NEXT();
+    }
+    VM_CASE(WRITE)
+    {
+        out << r[pc->a];
+        VM_NEXT();
+    }
+    VM_CASE(WRITENL)
+    {
+        out << '\n';
+        VM_NEXT();
+    }
+    VM_CASE(CALL)
+    {
+        const Function& f = functions[pc->b];
+        size_t callee = fp + pc->c;
+        if (callee + f.frame_size > stack.size()) {
+            if (callee + f.frame_size > VM_STACK_MAX)
+                throw std::runtime_error("stack overflow in " + f.name);
+            stack.resize(std::max(stack.size() * 2, callee + f.frame_size));
+        }
+        frames.push_back({ (u32)(pc - base) + 1, pc->a, fp });
+        fp = callee;
+        r = stack.data() + fp;
+        VM_JUMP(f.entry);
+    }
+    VM_CASE(RET)
+    {
+        i64 v = r[pc->a];
+        if (frames.empty())
+            return;
+        Frame f = frames.back();
+        frames.pop_back();
+        fp = f.fp;
+        r = stack.data() + fp;
+        r[f.dst] = v;
+        VM_JUMP(f.ret);
+    }
+    VM_CASE(HALT)
+    {
+        return;
+    }
+
+#ifndef VM_THREADED
+        }
+    }
+#endif
+
+#undef VM_BRANCH
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_JUMP
+}
+
+#pragma GCC diagnostic pop
+
+std::ostream& operator<<(std::ostream& os, const VM& vm)
+{
+    static const char* names[] = {
+        "loadk", "mov", "add", "sub", "mul", "div", "cmp",
+        "jmp", "jne", "jeq", "jle", "jlt", "jge", "jgt",
+        "read", "write", "writeNL", "call", "ret", "halt"
+    };
+
+    for (size_t i = 0; i < vm.code.size(); i++) {
+        for (auto& f : vm.functions)
+            if (f.entry == i)
+                os << f.name << " (frame " << f.frame_size << "):" << std::endl;
+
+        const auto& c = vm.code[i];
+        os << "  " << i << ": " << names[(u8)c.op];
+        switch (c.op) {
+        case Op::LOADK:
+            os << " r" << c.a << " #" << vm.consts[c.b];
+            break;
+        case Op::MOV:
+            os << " r" << c.a << " r" << c.b;
+            break;
+        case Op::JMP:
+            os << " " << c.a;
+            break;
+        case Op::CALL:
+            os << " r" << c.a << " " << vm.functions[c.b].name << " +" << c.c;
+            break;
+        case Op::READ:
+        case Op::WRITE:
+        case Op::RET:
+            os << " r" << c.a;
+            break;
+        case Op::WRITENL:
+        case Op::HALT:
+            break;
+        case Op::JNE:
+        case Op::JEQ:
+        case Op::JLE:
+        case Op::JLT:
+        case Op::JGE:
+        case Op::JGT:
+            os << " r" << c.a << " r" << c.b << " " << c.c;
+            break;
+        default:
+            os << " r" << c.a << " r" << c.b << " r" << c.c;
+            break;
+        }
+        os << std::endl;
+    }
+    return os;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <iostream>
+
+#include "ssa.h"
+
+// register bytecode, operands are frame slots unless noted otherwise
+enum class Op : u8 {
+    LOADK, // a = consts[b]
+    MOV, // a = b
+    ADD, // a = b + c
+    SUB, // a = b - c
+    MUL, // a = b * c
+    DIV, // a = b / c
+    CMP, // a = cmp b c
+    JMP, // jump to a
+    JNE, // jump to c if a != b
+    JEQ, // jump to c if a == b
+    JLE, // jump to c if a <= b
+    JLT, // jump to c if a < b
+    JGE, // jump to c if a >= b
+    JGT, // jump to c if a > b
+    READ, // a = read
+    WRITE, // write a
+    WRITENL, // write newline
+    CALL, // a = call functions[b], callee frame starts at slot c
+    RET, // return a
+    HALT,
+};
+
+struct Code {
+    Op op;
+    u32 a, b, c;
+};
+
+class VM {
+public:
+    VM(const std::deque<SSA>& ir, const FunctionMap& functions);
+
+    // runs main, throws std::runtime_error on runtime errors
+    void run(std::istream& in, std::ostream& out);
+
+    inline size_t size() const { return code.size(); }
+
+    friend std::ostream& operator<<(std::ostream& os, const VM& vm);
+
+private:
+    struct Function {
+        std::string name;
+        u32 entry;
+        u32 frame_size; // including outgoing params
+    };
+
+    struct Frame {
+        u32 ret;
+        u32 dst;
+        size_t fp;
+    };
+
+    std::vector<Code> code;
+    std::vector<i64> consts;
+    std::vector<Function> functions;
+
+    std::vector<i64> stack;
+    std::vector<Frame> frames;
+
+    void lower(const SSA& ssa, const std::unordered_map<u64, u32>& jump_to_func, Function& func);
+};
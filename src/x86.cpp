@@ -0,0 +1,484 @@
+#include "x86.h"
+#include "parallel_move.h"
+#include "regalloc.h"
+
+#include <algorithm>
+
+// System V integer argument registers
+static const Reg arg_regs[] = { Reg::RDI, Reg::RSI, Reg::RDX, Reg::RCX, Reg::R8, Reg::R9 };
+#define ARG_REG_COUNT 6
+
+X86::X86(const std::deque<SSA>& ir, const FunctionMap& functionMap)
+{
+    auto jump_to_func = function_indices(functionMap);
+
+    functions.resize(ir.size());
+    for (size_t i = 0; i < ir.size(); i++) {
+        functions[i].name = ir[i].name;
+        functions[i].symbol = i == 0 ? "main" : "tiny_" + ir[i].name;
+    }
+    for (size_t i = 0; i < ir.size(); i++)
+        lower(ir[i], jump_to_func, functions[i], i == 0);
+}
+
+static Cond branch_cond(InstrType type)
+{
+    switch (type) {
+    case InstrType::BNE:
+        return Cond::NE;
+    case InstrType::BEQ:
+        return Cond::E;
+    case InstrType::BLE:
+        return Cond::LE;
+    case InstrType::BLT:
+        return Cond::L;
+    case InstrType::BGE:
+        return Cond::GE;
+    case InstrType::BGT:
+        return Cond::G;
+    default:
+        break;
+    }
+    throw std::runtime_error("not a branch");
+}
+
+// values live where the register allocator put them, spill slots are below rbp
+// and callee saved registers are pushed below the spill slots
+void X86::lower(const SSA& ssa, const std::unordered_map<u64, u32>& jump_to_func, MFunction& func, bool isMain)
+{
+    auto order = ssa.reverse_post_order();
+    RegAlloc ra(order);
+    auto& code = func.code;
+
+    const auto emit = [&](MOp op, Operand dst = {}, Operand src = {}, Cond cc = Cond::E) {
+        code.push_back({ op, cc, dst, src });
+    };
+
+    std::unordered_map<u64, const Instr*> defs;
+    for (auto* b : order)
+        for (auto& instr : b->get_instructions())
+            defs[instr.pos] = &instr;
+
+    const auto& saved = ra.get_callee_saved();
+    u32 frame = 8 * ra.get_spill_slots();
+    if ((frame + 8 * saved.size()) % 16)
+        frame += 8;
+
+    // memory to memory and wide immediates to memory go through rax
+    const auto move = [&](const Operand& dst, const Operand& src) {
+        if (dst == src)
+            return;
+        if (dst.isMem() && (src.isMem() || (src.isImm() && !src.isImm32()))) {
+            emit(MOp::MOV, Operand::r(Reg::RAX), src);
+            emit(MOp::MOV, dst, Operand::r(Reg::RAX));
+        } else {
+            emit(MOp::MOV, dst, src);
+        }
+    };
+
+    // r11 is neither allocated nor an argument register
+    const auto emit_moves = [&](std::vector<std::pair<Operand, Operand>> moves) {
+        emit_parallel_moves(std::move(moves), Operand::r(Reg::R11), move);
+    };
+
+    const auto has_moves = [](const std::vector<std::pair<Operand, Operand>>& moves) {
+        return std::any_of(moves.begin(), moves.end(), [](auto& m) { return !(m.first == m.second); });
+    };
+
+    // source operand of a two operand instruction, wide immediates go through scratch
+    const auto source = [&](Operand o, Reg scratch) {
+        if (o.isImm() && !o.isImm32()) {
+            emit(MOp::MOV, Operand::r(scratch), o);
+            return Operand::r(scratch);
+        }
+        return o;
+    };
+
+    const auto epilogue = [&]() {
+        for (auto r = saved.rbegin(); r != saved.rend(); ++r)
+            emit(MOp::POP, Operand::r(*r));
+        emit(MOp::MOV, Operand::r(Reg::RSP), Operand::r(Reg::RBP));
+        emit(MOp::POP, Operand::r(Reg::RBP));
+        emit(MOp::RET);
+    };
+
+    // prologue, rsp stays 16 byte aligned for calls
+    emit(MOp::PUSH, Operand::r(Reg::RBP));
+    emit(MOp::MOV, Operand::r(Reg::RBP), Operand::r(Reg::RSP));
+    if (frame > 0)
+        emit(MOp::SUB, Operand::r(Reg::RSP), Operand::imm(frame));
+    for (auto r : saved)
+        emit(MOp::PUSH, Operand::r(r));
+
+    // params past the argument registers are on the stack above the return address
+    std::vector<std::pair<Operand, Operand>> params;
+    for (auto* b : order) {
+        for (auto& instr : b->get_instructions()) {
+            if (instr.type != InstrType::GETP)
+                continue;
+            i32 k = *instr.y;
+            params.emplace_back(ra.location(instr.pos, 0),
+                k <= ARG_REG_COUNT ? Operand::r(arg_regs[k - 1]) : Operand::mem(Reg::RBP, 16 + 8 * (k - ARG_REG_COUNT - 1)));
+        }
+    }
+    emit_moves(std::move(params));
+
+    std::unordered_map<Block*, u32> labels;
+    for (auto* b : order)
+        labels[b] = func.labels++;
+    std::vector<std::pair<u32, std::pair<Block*, Block*>>> trampolines;
+
+    std::vector<std::optional<u64>> args;
+    for (size_t i = 0; i < order.size(); i++) {
+        Block* b = order[i];
+        Block* next = i + 1 < order.size() ? order[i + 1] : nullptr;
+        emit(MOp::LABEL, Operand::label(labels[b]));
+
+        bool returned = false;
+        const Instr* branch = nullptr;
+        for (auto& instr : b->get_instructions()) {
+            u32 n = ra.number(instr);
+            const auto use = [&](std::optional<u64> v) { return ra.location(v, n); };
+            const Operand dst = ra.location(instr.pos, n + 2);
+
+            emit_moves(ra.moves_at(n));
+            emit_moves(ra.moves_at(n + 2));
+            switch (instr.type) {
+            case InstrType::ADD:
+            case InstrType::SUB:
+            case InstrType::MUL: {
+                MOp op = instr.type == InstrType::ADD ? MOp::ADD : instr.type == InstrType::MUL ? MOp::IMUL
+                                                                                                 : MOp::SUB;
+                // compute in place unless that would overwrite the right operand first
+                Operand x = use(instr.x), y = use(instr.y);
+                if (op != MOp::SUB && y == dst && !(x == dst))
+                    std::swap(x, y);
+                Reg r = dst.isReg() && !(y == dst) ? dst.reg : Reg::RAX;
+                move(Operand::r(r), x);
+                emit(op, Operand::r(r), source(y, Reg::R11));
+                move(dst, Operand::r(r));
+            } break;
+            case InstrType::CMP: {
+                // a fused cmp is compared by its branch, otherwise it is -1, 0 or 1
+                // as in the vm, a difference would overflow
+                if (ra.is_fused(instr))
+                    break;
+                move(Operand::r(Reg::RAX), use(instr.x));
+                emit(MOp::CMP, Operand::r(Reg::RAX), source(use(instr.y), Reg::R11));
+                emit(MOp::SETCC, Operand::r(Reg::RAX), {}, Cond::G);
+                emit(MOp::SETCC, Operand::r(Reg::R11), {}, Cond::L);
+                emit(MOp::MOVZB, Operand::r(Reg::RAX), Operand::r(Reg::RAX));
+                emit(MOp::MOVZB, Operand::r(Reg::R11), Operand::r(Reg::R11));
+                emit(MOp::SUB, Operand::r(Reg::RAX), Operand::r(Reg::R11));
+                move(dst, Operand::r(Reg::RAX));
+            } break;
+            case InstrType::DIV: {
+                // idiv traps on zero and on INT64_MIN / -1, the vm fails on the
+                // first and wraps the second, so both are tested for first
+                move(Operand::r(Reg::RAX), use(instr.x));
+                Operand y = use(instr.y);
+                if (y.isImm() && y.val == 0) {
+                    emit(MOp::CALL, Operand::runtime(Runtime::DIV_ZERO));
+                } else if (y.isImm() && y.val == -1) {
+                    emit(MOp::IMUL, Operand::r(Reg::RAX), y);
+                } else if (y.isImm()) {
+                    emit(MOp::MOV, Operand::r(Reg::R11), y);
+                    emit(MOp::CQO);
+                    emit(MOp::IDIV, Operand::r(Reg::R11));
+                } else {
+                    if (!y.isReg()) {
+                        emit(MOp::MOV, Operand::r(Reg::R11), y);
+                        y = Operand::r(Reg::R11);
+                    }
+                    u32 nonzero = func.labels++, divide = func.labels++, done = func.labels++;
+                    emit(MOp::CMP, y, Operand::imm(0));
+                    emit(MOp::JCC, Operand::label(nonzero), {}, Cond::NE);
+                    emit(MOp::CALL, Operand::runtime(Runtime::DIV_ZERO));
+                    emit(MOp::LABEL, Operand::label(nonzero));
+                    emit(MOp::CMP, y, Operand::imm(-1));
+                    emit(MOp::JCC, Operand::label(divide), {}, Cond::NE);
+                    emit(MOp::IMUL, Operand::r(Reg::RAX), Operand::imm(-1));
+                    emit(MOp::JMP, Operand::label(done));
+                    emit(MOp::LABEL, Operand::label(divide));
+                    emit(MOp::CQO);
+                    emit(MOp::IDIV, y);
+                    emit(MOp::LABEL, Operand::label(done));
+                }
+                move(dst, Operand::r(Reg::RAX));
+            } break;
+            case InstrType::BNE:
+            case InstrType::BEQ:
+            case InstrType::BLE:
+            case InstrType::BLT:
+            case InstrType::BGE:
+            case InstrType::BGT: {
+                // sets the flags for the jcc closing the block, a fused cmp is emitted
+                // here as cmpq of its operands, any other condition as cmpq $0
+                branch = &instr;
+                auto cmp = defs.find(*instr.x);
+                Operand x, y = Operand::imm(0);
+                if (cmp != defs.end() && ra.is_fused(*cmp->second)) {
+                    x = use(cmp->second->x);
+                    y = use(cmp->second->y);
+                } else {
+                    x = use(instr.x);
+                }
+                if (!x.isReg()) {
+                    emit(MOp::MOV, Operand::r(Reg::RAX), x);
+                    x = Operand::r(Reg::RAX);
+                }
+                emit(MOp::CMP, x, source(y, Reg::R11));
+            } break;
+            case InstrType::READ:
+                emit(MOp::CALL, Operand::runtime(Runtime::READ));
+                move(dst, Operand::r(Reg::RAX));
+                break;
+            case InstrType::WRITE:
+                move(Operand::r(Reg::RDI), use(instr.x));
+                emit(MOp::CALL, Operand::runtime(Runtime::WRITE));
+                break;
+            case InstrType::WRITENL:
+                emit(MOp::CALL, Operand::runtime(Runtime::WRITENL));
+                break;
+            case InstrType::SETP:
+                // read by the call
+                if (args.size() < *instr.y)
+                    args.resize(*instr.y);
+                args[*instr.y - 1] = instr.x;
+                break;
+            case InstrType::JUMP: {
+                auto f = jump_to_func.find(*instr.x);
+                if (f == jump_to_func.end())
+                    throw std::runtime_error("jump to unknown function " + std::to_string(*instr.x));
+
+                u32 stack_args = args.size() > ARG_REG_COUNT ? args.size() - ARG_REG_COUNT : 0;
+                u32 pad = (stack_args % 2) * 8;
+                if (pad)
+                    emit(MOp::SUB, Operand::r(Reg::RSP), Operand::imm(pad));
+                for (size_t k = args.size(); k > ARG_REG_COUNT; k--) {
+                    move(Operand::r(Reg::RAX), use(args[k - 1]));
+                    emit(MOp::PUSH, Operand::r(Reg::RAX));
+                }
+                std::vector<std::pair<Operand, Operand>> moves;
+                for (size_t k = 0; k < args.size() && k < ARG_REG_COUNT; k++)
+                    moves.emplace_back(Operand::r(arg_regs[k]), use(args[k]));
+                emit_moves(std::move(moves));
+                emit(MOp::CALL, Operand::func(f->second));
+                if (stack_args || pad)
+                    emit(MOp::ADD, Operand::r(Reg::RSP), Operand::imm(8 * stack_args + pad));
+                move(dst, Operand::r(Reg::RAX));
+                args.clear();
+            } break;
+            case InstrType::RET:
+                if (isMain)
+                    emit(MOp::MOV, Operand::r(Reg::RAX), Operand::imm(0));
+                else
+                    move(Operand::r(Reg::RAX), use(instr.x));
+                epilogue();
+                returned = true;
+                break;
+            default: // CONST, PHI, GETP, BRA and NONE produce no code
+                break;
+            }
+            if (returned)
+                break;
+        }
+        if (returned)
+            continue;
+
+        // moves do not touch the flags, the end slot goes between the compare and the jump
+        emit_moves(ra.moves_at(ra.block_end(b)));
+
+        auto succ = b->successors();
+        if (branch) {
+            Block* fall = succ[0];
+            Block* taken = succ[1];
+
+            u32 target = labels[taken];
+            if (has_moves(ra.edge_moves(b, taken))) {
+                target = func.labels++;
+                trampolines.emplace_back(target, std::make_pair(b, taken));
+            }
+            emit(MOp::JCC, Operand::label(target), {}, branch_cond(branch->type));
+
+            emit_moves(ra.edge_moves(b, fall));
+            if (fall != next)
+                emit(MOp::JMP, Operand::label(labels[fall]));
+        } else if (!succ.empty()) {
+            emit_moves(ra.edge_moves(b, succ[0]));
+            if (succ[0] != next)
+                emit(MOp::JMP, Operand::label(labels[succ[0]]));
+        } else {
+            emit(MOp::MOV, Operand::r(Reg::RAX), Operand::imm(0));
+            epilogue();
+        }
+    }
+
+    // conditional edges needing moves get their own move block
+    for (auto& [label, edge] : trampolines) {
+        emit(MOp::LABEL, Operand::label(label));
+        emit_moves(ra.edge_moves(edge.first, edge.second));
+        emit(MOp::JMP, Operand::label(labels[edge.second]));
+    }
+}
+
+/// ASSEMBLY ///
+
+static const char* reg_name(Reg r)
+{
+    static const char* names[] = {
+        "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+        "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"
+    };
+    return names[(u8)r];
+}
+
+static const char* byte_reg_name(Reg r)
+{
+    static const char* names[] = {
+        "%al", "%cl", "%dl", "%bl", "%spl", "%bpl", "%sil", "%dil",
+        "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b"
+    };
+    return names[(u8)r];
+}
+
+static const char* cond_name(Cond cc)
+{
+    switch (cc) {
+    case Cond::E:
+        return "e";
+    case Cond::NE:
+        return "ne";
+    case Cond::L:
+        return "l";
+    case Cond::GE:
+        return "ge";
+    case Cond::LE:
+        return "le";
+    case Cond::G:
+        return "g";
+    }
+    return "";
+}
+
+static const char* runtime_name(Runtime rt)
+{
+    switch (rt) {
+    case Runtime::READ:
+        return "ty_read";
+    case Runtime::WRITE:
+        return "ty_write";
+    case Runtime::WRITENL:
+        return "ty_writeNL";
+    case Runtime::DIV_ZERO:
+        return "ty_div_zero";
+    }
+    return "";
+}
+
+void X86::emit_asm(std::ostream& os) const
+{
+    for (size_t f = 0; f < functions.size(); f++) {
+        const auto& func = functions[f];
+
+        const auto op = [&](const Operand& o) {
+            switch (o.kind) {
+            case Operand::Kind::REG:
+                os << reg_name(o.reg);
+                break;
+            case Operand::Kind::MEM:
+                os << o.val << "(" << reg_name(o.reg) << ")";
+                break;
+            case Operand::Kind::IMM:
+                os << "$" << o.val;
+                break;
+            case Operand::Kind::LABEL:
+                os << ".L" << f << "_" << o.val;
+                break;
+            case Operand::Kind::FUNC:
+                os << functions[o.val].symbol;
+                break;
+            case Operand::Kind::RUNTIME:
+                os << runtime_name((Runtime)o.val);
+                break;
+            case Operand::Kind::NONE:
+                break;
+            }
+        };
+
+        // AT&T order, source first
+        const auto two = [&](const char* name, const MInstr& i) {
+            os << "\t" << name << "\t";
+            op(i.src);
+            os << ", ";
+            op(i.dst);
+            os << "\n";
+        };
+        const auto one = [&](const char* name, const Operand& o) {
+            os << "\t" << name << "\t";
+            op(o);
+            os << "\n";
+        };
+
+        os << "\t.text\n";
+        if (f == 0)
+            os << "\t.globl\t" << func.symbol << "\n";
+        os << "\t.type\t" << func.symbol << ", @function\n";
+        os << func.symbol << ":\n";
+        for (const auto& i : func.code) {
+            switch (i.op) {
+            case MOp::MOV:
+                two(i.src.isImm() && !i.src.isImm32() ? "movabsq" : "movq", i);
+                break;
+            case MOp::ADD:
+                two("addq", i);
+                break;
+            case MOp::SUB:
+                two("subq", i);
+                break;
+            case MOp::IMUL:
+                two("imulq", i);
+                break;
+            case MOp::CMP:
+                two("cmpq", i);
+                break;
+            case MOp::CQO:
+                os << "\tcqto\n";
+                break;
+            case MOp::SETCC:
+                os << "\tset" << cond_name(i.cc) << "\t" << byte_reg_name(i.dst.reg) << "\n";
+                break;
+            case MOp::MOVZB:
+                os << "\tmovzbq\t" << byte_reg_name(i.src.reg) << ", " << reg_name(i.dst.reg) << "\n";
+                break;
+            case MOp::IDIV:
+                one("idivq", i.dst);
+                break;
+            case MOp::PUSH:
+                one("pushq", i.dst);
+                break;
+            case MOp::POP:
+                one("popq", i.dst);
+                break;
+            case MOp::JMP:
+                one("jmp", i.dst);
+                break;
+            case MOp::JCC:
+                one((std::string("j") + cond_name(i.cc)).c_str(), i.dst);
+                break;
+            case MOp::CALL:
+                one("call", i.dst);
+                break;
+            case MOp::RET:
+                os << "\tret\n";
+                break;
+            case MOp::LABEL:
+                op(i.dst);
+                os << ":\n";
+                break;
+            }
+        }
+        os << "\t.size\t" << func.symbol << ", .-" << func.symbol << "\n\n";
+    }
+    os << "\t.section\t.note.GNU-stack,\"\",@progbits\n";
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <iostream>
+
+#include "ssa.h"
+
+// x86-64 System V code generation, every function is lowered into MInstrs
+// which are printed as GNU as (AT&T) text or encoded directly.
+
+// in hardware encoding order
+enum class Reg : u8 {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+
+// in hardware encoding order, the low nibble of jcc
+enum class Cond : u8 {
+    E = 0x4,
+    NE = 0x5,
+    L = 0xC,
+    GE = 0xD,
+    LE = 0xE,
+    G = 0xF,
+};
+
+// builtins, implemented in runtime.c
+enum class Runtime : u8 {
+    READ,
+    WRITE,
+    WRITENL,
+    DIV_ZERO,
+};
+
+struct Operand {
+    enum class Kind : u8 {
+        NONE,
+        REG,
+        MEM, // [reg + val]
+        IMM,
+        LABEL,
+        FUNC, // index into X86::get_functions()
+        RUNTIME,
+    } kind
+        = Kind::NONE;
+    Reg reg = Reg::RAX;
+    i64 val = 0;
+
+    static inline Operand r(Reg reg) { return { Kind::REG, reg, 0 }; }
+    static inline Operand mem(Reg base, i32 disp) { return { Kind::MEM, base, disp }; }
+    static inline Operand imm(i64 val) { return { Kind::IMM, Reg::RAX, val }; }
+    static inline Operand label(u32 id) { return { Kind::LABEL, Reg::RAX, id }; }
+    static inline Operand func(u32 id) { return { Kind::FUNC, Reg::RAX, id }; }
+    static inline Operand runtime(Runtime rt) { return { Kind::RUNTIME, Reg::RAX, (i64)rt }; }
+
+    inline bool isReg() const { return kind == Kind::REG; }
+    inline bool isMem() const { return kind == Kind::MEM; }
+    inline bool isImm() const { return kind == Kind::IMM; }
+    inline bool isImm32() const { return kind == Kind::IMM && val >= INT32_MIN && val <= INT32_MAX; }
+
+    inline bool operator==(const Operand& o) const { return kind == o.kind && reg == o.reg && val == o.val; }
+};
+
+// forms:
+// MOV r, r|m|imm / m, r|imm32
+// ADD, SUB, IMUL, CMP r, r|m|imm32
+// IDIV r|m, PUSH r, POP r
+// SETCC r (low byte), MOVZB r, r (low byte)
+// JMP label, JCC label, CALL func|runtime, LABEL label
+enum class MOp : u8 {
+    MOV,
+    ADD,
+    SUB,
+    IMUL,
+    CMP,
+    CQO,
+    IDIV,
+    SETCC,
+    MOVZB,
+    PUSH,
+    POP,
+    JMP,
+    JCC,
+    CALL,
+    RET,
+    LABEL,
+};
+
+struct MInstr {
+    MOp op;
+    Cond cc;
+    Operand dst, src;
+};
+
+struct MFunction {
+    std::string name;
+    std::string symbol;
+    std::vector<MInstr> code;
+    u32 labels = 0;
+};
+
+class X86 {
+public:
+    X86(const std::deque<SSA>& ir, const FunctionMap& functions);
+
+    void emit_asm(std::ostream& os) const;
+
+    inline const std::vector<MFunction>& get_functions() const { return functions; }
+
+private:
+    std::vector<MFunction> functions;
+
+    void lower(const SSA& ssa, const std::unordered_map<u64, u32>& jump_to_func, MFunction& func, bool isMain);
+};
@@ -0,0 +1,61 @@
+#include "test_common.h"
+
+#include <fstream>
+#include <unistd.h>
+
+#include "batch.h"
+
+// one per test, ctest runs them side by side
+static std::filesystem::path batch_dir()
+{
+    auto name = testing::UnitTest::GetInstance()->current_test_info()->name();
+    auto dir = std::filesystem::temp_directory_path() / ("ty_batch_" + std::to_string(getpid()) + "_" + name);
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "out");
+    std::ofstream(dir / "a.ty") << "main var x; { let x <- call InputNum; call OutputNum(x * 2) }.";
+    std::ofstream(dir / "b.ty") << "main var x; { let x <- 1 }"; // no period
+    std::ofstream(dir / "c.ty") << "main function f(a); { return a + 1 }; { call OutputNum(call f(1)) }.";
+    std::ofstream(dir / "notes.txt") << "not a program";
+    return dir;
+}
+
+TEST(Batch, Directory)
+{
+    auto dir = batch_dir();
+    auto files = batch_inputs(dir);
+    ASSERT_EQ(files.size(), 3u);
+    EXPECT_EQ(files[0].filename(), "a.ty");
+    EXPECT_EQ(files[2].filename(), "c.ty");
+
+    BatchOptions options;
+    options.jobs = 2;
+    std::ostringstream report;
+    EXPECT_EQ(compile_batch(files, options, report), 1u);
+    EXPECT_TRUE(std::filesystem::file_size(dir / "a.dot") > 0);
+    EXPECT_FALSE(std::filesystem::exists(dir / "b.dot"));
+    EXPECT_TRUE(std::filesystem::file_size(dir / "c.dot") > 0);
+
+    std::string s = report.str();
+    EXPECT_NE(s.find("b.ty: Expected PERIOD, but got EOF"), std::string::npos) << s;
+    EXPECT_NE(s.find("3 files, 1 failed"), std::string::npos) << s;
+    std::filesystem::remove_all(dir);
+}
+
+TEST(Batch, ListIntoDirectory)
+{
+    auto dir = batch_dir();
+    std::ofstream(dir / "list") << "c.ty\n\na.ty\n";
+    auto files = batch_inputs(dir / "list");
+    ASSERT_EQ(files.size(), 2u);
+    EXPECT_EQ(files[0], dir / "c.ty");
+
+    BatchOptions options;
+    options.jobs = 4;
+    options.assembly = true;
+    options.out_dir = dir / "out";
+    std::ostringstream report;
+    EXPECT_EQ(compile_batch(files, options, report), 0u);
+    EXPECT_TRUE(std::filesystem::file_size(dir / "out" / "a.s") > 0);
+    EXPECT_TRUE(std::filesystem::file_size(dir / "out" / "c.s") > 0);
+    std::filesystem::remove_all(dir);
+}
@@ -1,8 +1,72 @@
 #include <gtest/gtest.h>
 #include <filesystem>
 
-#define GET_BASIC(str) (BASIC_TESTS str)
-#define GET_INTERMEDIATE(str) (INTERMEDIATE_TESTS str)
-#define GET_COMPLEX(str) (COMPLEX_TESTS str)
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+#define GET_BASIC(str) std::filesystem::path(BASIC_TESTS str)
+#define GET_INTERMEDIATE(str) std::filesystem::path(INTERMEDIATE_TESTS str)
+#define GET_COMPLEX(str) std::filesystem::path(COMPLEX_TESTS str)
 
 extern std::vector<std::filesystem::path> getFiles(std::string folder);
+
+// the program in a source string or in the file at a path, optimized on request
+template <typename Source>
+inline std::unique_ptr<Parser> parse(const Source& source, bool optimize = false)
+{
+    TokenList toks;
+    if constexpr (std::is_same_v<Source, std::filesystem::path>)
+        EXPECT_TRUE(toks.tokenize(source));
+    else
+        EXPECT_TRUE(toks.tokenize(std::string(source)));
+    auto p = std::make_unique<Parser>(std::move(toks));
+    EXPECT_EQ(p->parse(), 0);
+    if (optimize)
+        p->optimize();
+    return p;
+}
+
+inline std::unique_ptr<Parser> parse_optimized(const std::string& s)
+{
+    return parse(s, true);
+}
+
+// output of the program on the vm
+inline std::string run(Parser& p, const std::string& input = "")
+{
+    std::istringstream in(input);
+    std::ostringstream out;
+    VM(p.get_ir(), p.get_functions()).run(in, out);
+    return out.str();
+}
+
+// instructions of the function, all of them or of one type
+inline size_t count(const SSA& ssa, std::optional<InstrType> type = std::nullopt)
+{
+    size_t n = 0;
+    for (auto* b : ssa.reverse_post_order())
+        for (auto& instr : b->get_instructions())
+            n += !type || instr.type == *type;
+    return n;
+}
+
+inline size_t count(const SSA& ssa, bool (*pred)(InstrType))
+{
+    size_t n = 0;
+    for (auto* b : ssa.reverse_post_order())
+        for (auto& instr : b->get_instructions())
+            n += pred(instr.type);
+    return n;
+}
+
+// instructions of the type inside of any loop
+inline size_t in_loops(const SSA& ssa, InstrType type)
+{
+    size_t n = 0;
+    for (auto* b : ssa.reverse_post_order())
+        if (ssa.loops().loop_of(b))
+            for (auto& instr : b->get_instructions())
+                n += instr.type == type;
+    return n;
+}
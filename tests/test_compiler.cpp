@@ -0,0 +1,150 @@
+#include "test_common.h"
+
+#include <fstream>
+#include <thread>
+
+#include "budget.h"
+#include "compiler.h"
+
+#define PROGRAM "main var x; { let x <- call InputNum; call OutputNum(x * 2 + 1) }."
+#define FUNCTIONS "main function f(a); { return a + 1 }; { call OutputNum(call f(call InputNum)) }."
+
+static std::string ssa_of(Compiler& compiler)
+{
+    std::ostringstream os;
+    EXPECT_TRUE(compiler.ssa(os));
+    return os.str();
+}
+
+TEST(CompilerTest, ErrorsAreValues)
+{
+    Compiler compiler;
+    EXPECT_FALSE(compiler.compile("main var x; { let x <- 1 }"));
+    EXPECT_FALSE(compiler.ok());
+    ASSERT_EQ(compiler.errors().size(), 1u);
+    EXPECT_EQ(compiler.errors()[0], "Expected PERIOD, but got EOF");
+
+    EXPECT_FALSE(compiler.compile("main var x; { let y <- 1 }."));
+    ASSERT_EQ(compiler.errors().size(), 1u);
+    EXPECT_EQ(compiler.errors()[0], "Unknown symbol 'y'");
+
+    EXPECT_FALSE(compiler.compile("main { let x <- 1 # 2 }."));
+    EXPECT_FALSE(compiler.errors().empty());
+
+    std::ostringstream os;
+    EXPECT_FALSE(compiler.assembly(os));
+
+    EXPECT_TRUE(compiler.compile(PROGRAM));
+    EXPECT_TRUE(compiler.ok());
+    EXPECT_TRUE(compiler.errors().empty());
+    EXPECT_EQ(compiler.ir().size(), 1u);
+}
+
+TEST(CompilerTest, Outputs)
+{
+    Compiler compiler;
+    ASSERT_TRUE(compiler.compile(FUNCTIONS));
+    std::istringstream in("41");
+    std::ostringstream out, dot, assembly;
+    EXPECT_TRUE(compiler.run(in, out));
+    EXPECT_EQ(out.str(), "42");
+    EXPECT_TRUE(compiler.dot(dot));
+    EXPECT_NE(dot.str().find("digraph"), std::string::npos);
+    EXPECT_TRUE(compiler.assembly(assembly));
+    EXPECT_NE(assembly.str().find("main:"), std::string::npos);
+
+    // a file compiles the same as its contents
+    auto file = std::filesystem::path(GET_BASIC("just_add.ty"));
+    std::ifstream is(file);
+    std::string source((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(compiler.compile_file(file));
+    std::string from_file = ssa_of(compiler);
+    ASSERT_TRUE(compiler.compile(source));
+    EXPECT_EQ(ssa_of(compiler), from_file);
+}
+
+TEST(CompilerTest, NoStateBetweenCompiles)
+{
+    Compiler compiler;
+    ASSERT_TRUE(compiler.compile(PROGRAM));
+    std::string first = ssa_of(compiler);
+    ASSERT_TRUE(compiler.compile(FUNCTIONS));
+    EXPECT_FALSE(compiler.compile("main { call f }."));
+    ASSERT_TRUE(compiler.compile(PROGRAM));
+    EXPECT_EQ(ssa_of(compiler), first);
+}
+
+// the ir comes from the budget and all of it goes back, anything else a
+// session keeps would show up as a leak under the sanitizers
+TEST(CompilerTest, ResetReleasesEverything)
+{
+    Budget budget(64 << 20, std::chrono::seconds(60));
+    Compiler compiler({ 2, true, &budget });
+    std::ostringstream os;
+    for (int i = 0; i < 300; i++) {
+        compiler.compile(i % 3 == 0 ? PROGRAM : i % 3 == 1 ? FUNCTIONS : "main var x; { let y <- 1 }.");
+        if (compiler.ok()) {
+            EXPECT_GT(budget.used(), 0);
+            compiler.assembly(os);
+        }
+        compiler.reset();
+        ASSERT_EQ(budget.used(), 0) << i;
+    }
+    EXPECT_GT(budget.peak(), 0);
+}
+
+// also from the bodies parsed on a pool, which take most of the memory
+TEST(CompilerTest, OutOfMemoryIsThrown)
+{
+    std::string s = "main var x;";
+    for (int f = 0; f < 2; f++) {
+        s += "function f" + std::to_string(f) + "(a); {";
+        for (int i = 0; i < 500; i++)
+            s += "let a <- a * " + std::to_string(i) + " + call InputNum; ";
+        s += "return a };";
+    }
+    s += "{ let x <- call f1(call f0(1)); call OutputNum(x) }.";
+
+    for (unsigned jobs : { 1, 2 }) {
+        i64 peak;
+        {
+            Budget budget(1 << 30, std::chrono::seconds(60));
+            Compiler compiler({ jobs, true, &budget });
+            ASSERT_TRUE(compiler.compile(s));
+            peak = budget.peak();
+        }
+        Budget budget(peak / 2, std::chrono::seconds(60));
+        Compiler compiler({ jobs, true, &budget });
+        EXPECT_THROW(compiler.compile(s), BudgetExceeded);
+        EXPECT_FALSE(compiler.ok());
+        EXPECT_EQ(budget.used(), 0);
+    }
+}
+
+TEST(CompilerTest, SessionsOnThreads)
+{
+    const char* sources[] = { PROGRAM, FUNCTIONS };
+    std::string expected[2];
+    for (int i = 0; i < 2; i++) {
+        Compiler compiler;
+        ASSERT_TRUE(compiler.compile(sources[i]));
+        expected[i] = ssa_of(compiler);
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<int> mismatches(4);
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            Compiler compiler;
+            for (int i = 0; i < 50; i++) {
+                int k = (t + i) % 2;
+                std::ostringstream os;
+                if (!compiler.compile(sources[k]) || !compiler.ssa(os) || os.str() != expected[k])
+                    mismatches[t]++;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ(mismatches, std::vector<int>(4));
+}
@@ -0,0 +1,92 @@
+#include "test_common.h"
+
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+// only the value of c reaches the output, a and b are dead and only the
+// counter of the loop is left
+static const char* dead = R"(
+    main
+    var a, b, c, i;
+    {
+        let a <- call InputNum;
+        let c <- a * 3;
+        let b <- a + 7;
+        let i <- 0;
+        while i < 10 do
+            let b <- b * b - a;
+            let a <- a + i / 2;
+            let i <- i + 1
+        od;
+        call OutputNum(c)
+    }.
+)";
+
+TEST(DCE, RemovesDeadValues)
+{
+    auto p = parse(dead);
+    auto& main = p->get_ir().front();
+    size_t before = count(main);
+    p->optimize();
+    EXPECT_LT(count(main), before);
+    EXPECT_EQ(count(main, InstrType::DIV), 0);
+    EXPECT_EQ(count(main, InstrType::PHI), 1);
+    EXPECT_EQ(count(main, InstrType::MUL), 1);
+    EXPECT_EQ(run(*p, "5"), "15");
+}
+
+TEST(DCE, KeepsSideEffects)
+{
+    auto p = parse(R"(
+        main
+        var x, y;
+        void function f(a); { call OutputNum(a) };
+        {
+            let x <- call InputNum;
+            let y <- call InputNum;
+            call f(x);
+            call OutputNewLine
+        }.
+    )");
+    p->optimize();
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(count(main, InstrType::READ), 2);
+    EXPECT_EQ(count(main, InstrType::WRITE), 1); // inlined from f
+    EXPECT_EQ(count(main, InstrType::WRITENL), 1);
+    EXPECT_EQ(run(*p, "4 2"), "4\n");
+}
+
+TEST(DCE, KeepsLoopCarriedValues)
+{
+    auto p = parse(R"(
+        main
+        var a, b, t, i; {
+            let a <- 1; let b <- 2; let i <- 0;
+            while i < 3 do
+                let t <- a; let a <- b; let b <- t; let i <- i + 1
+            od;
+            call OutputNum(a)
+        }.
+    )");
+    p->optimize();
+    EXPECT_EQ(run(*p, ""), "2");
+}
+
+TEST(DCE, KeepsDivisionsThatMayTrap)
+{
+    auto p = parse(R"(
+        main
+        var x, y; {
+            let x <- call InputNum;
+            call OutputNum(x);
+            let y <- x / 0;
+            let y <- x / (x - 1);
+            let y <- x / 2
+        }.
+    )");
+    p->optimize();
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(count(main, InstrType::DIV), 2);
+    EXPECT_THROW(run(*p, "4"), std::runtime_error);
+}
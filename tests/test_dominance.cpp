@@ -0,0 +1,162 @@
+#include "test_common.h"
+
+#include "dominance.h"
+#include "parser.h"
+#include "token.h"
+
+static Block* branch_block(const SSA& ssa, size_t n)
+{
+    for (auto* b : ssa.reverse_post_order())
+        if (!b->get_instructions().empty() && isBranch(b->get_instructions().back().type) && n-- == 0)
+            return b;
+    return nullptr;
+}
+
+TEST(Dominance, IfElse)
+{
+    auto p = parse(R"(
+        main
+        var x;
+        {
+            let x <- call InputNum;
+            if x > 0 then
+                let x <- x + 1
+            else
+                let x <- x - 1
+            fi;
+            call OutputNum(x)
+        }.
+    )");
+    auto& ssa = p->get_ir().front();
+    auto& dom = ssa.dominators();
+
+    Block* cond = branch_block(ssa, 0);
+    Block* then = cond->left;
+    Block* other = cond->right;
+    Block* join = then->right;
+    ASSERT_EQ(join, other->left);
+
+    EXPECT_EQ(dom.idom(then), cond);
+    EXPECT_EQ(dom.idom(other), cond);
+    EXPECT_EQ(dom.idom(join), cond);
+    EXPECT_EQ(dom.idom(ssa.get_head()), nullptr);
+    EXPECT_TRUE(dom.dominates(ssa.get_head(), join));
+    EXPECT_TRUE(dom.dominates(cond, cond));
+    EXPECT_FALSE(dom.strictly_dominates(cond, cond));
+    EXPECT_FALSE(dom.dominates(then, join));
+    EXPECT_FALSE(dom.dominates(then, other));
+
+    EXPECT_EQ(dom.frontier(then), std::vector<Block*> { join });
+    EXPECT_EQ(dom.frontier(other), std::vector<Block*> { join });
+    EXPECT_TRUE(dom.frontier(cond).empty());
+    EXPECT_EQ(dom.predecessors(join).size(), 2);
+    EXPECT_EQ(dom.children(cond).size(), 3);
+}
+
+TEST(Dominance, Loop)
+{
+    auto p = parse(R"(
+        main
+        var i;
+        {
+            let i <- 0;
+            while i < 10 do
+                if i == 5 then
+                    call OutputNum(i)
+                fi;
+                let i <- i + 1
+            od;
+            call OutputNum(i)
+        }.
+    )");
+    auto& ssa = p->get_ir().front();
+    auto& dom = ssa.dominators();
+
+    Block* header = branch_block(ssa, 0);
+    Block* body = header->left;
+    Block* exit = header->right;
+    ASSERT_TRUE(header->get_instructions().front().type == InstrType::PHI);
+
+    EXPECT_EQ(dom.idom(body), header);
+    EXPECT_EQ(dom.idom(exit), header);
+    EXPECT_TRUE(dom.dominates(header, body));
+    EXPECT_FALSE(dom.dominates(body, header));
+    EXPECT_FALSE(dom.dominates(body, exit));
+
+    // the header is in its own frontier and in the one of everything in the body
+    EXPECT_EQ(dom.frontier(header), std::vector<Block*> { header });
+    EXPECT_EQ(dom.frontier(body), std::vector<Block*> { header });
+    EXPECT_EQ(dom.predecessors(header).size(), 2);
+}
+
+TEST(Dominance, InvalidatedWhenTheCfgChanges)
+{
+    auto p = parse(R"(
+        main
+        var x;
+        {
+            let x <- call InputNum;
+            if 1 > 2 then
+                let x <- x + 1
+            fi;
+            call OutputNum(x)
+        }.
+    )");
+    auto& ssa = p->get_ir().front();
+    size_t before = ssa.dominators().get_order().size();
+    Block* dead = branch_block(ssa, 0)->left;
+    EXPECT_TRUE(ssa.dominators().contains(dead));
+
+    p->optimize();
+    EXPECT_LT(ssa.dominators().get_order().size(), before);
+    EXPECT_EQ(ssa.dominators().get_order(), ssa.reverse_post_order());
+}
+
+// a dominates b if b can not be reached from the head without going through a
+static bool dominates_by_search(const SSA& ssa, Block* a, Block* b)
+{
+    if (a == b)
+        return true;
+    std::unordered_set<Block*> seen = { a };
+    std::vector<Block*> stack = { ssa.get_head() };
+    while (!stack.empty()) {
+        Block* n = stack.back();
+        stack.pop_back();
+        if (n == b)
+            return false;
+        if (!seen.insert(n).second)
+            continue;
+        for (auto* s : n->successors())
+            stack.push_back(s);
+    }
+    return true;
+}
+
+class DominanceTest : public testing::TestWithParam<std::filesystem::path> { };
+
+TEST_P(DominanceTest, MatchesSearch)
+{
+    TokenList toks;
+    ASSERT_TRUE(toks.tokenize(GetParam()));
+    Parser p(std::move(toks));
+    ASSERT_EQ(p.parse(), 0);
+
+    for (auto& ssa : p.get_ir()) {
+        auto& dom = ssa.dominators();
+        auto order = ssa.reverse_post_order();
+        for (auto* a : order) {
+            for (auto* b : order) {
+                EXPECT_EQ(dom.dominates(a, b), dominates_by_search(ssa, a, b));
+                // b is in the frontier of a if a dominates a predecessor of b but not b itself
+                bool in_frontier = false;
+                for (auto* pred : dom.predecessors(b))
+                    in_frontier |= dom.dominates(a, pred) && !dom.strictly_dominates(a, b);
+                auto& frontier = dom.frontier(a);
+                EXPECT_EQ(std::count(frontier.begin(), frontier.end(), b), in_frontier);
+            }
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(IntermediateSuite, DominanceTest, testing::ValuesIn(getFiles(INTERMEDIATE_TESTS)));
+INSTANTIATE_TEST_SUITE_P(ComplexSuite, DominanceTest, testing::ValuesIn(getFiles(COMPLEX_TESTS)));
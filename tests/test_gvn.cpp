@@ -0,0 +1,109 @@
+#include "test_common.h"
+
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+// b and c take the same values on both edges, their phis merge and so do b * 2
+// and c * 2 after the join
+TEST(GVN, CongruentPhis)
+{
+    auto p = parse(R"(
+        main
+        var a, b, c; {
+            let a <- call InputNum;
+            if a > 0 then
+                let b <- a + 1;
+                let c <- a + 1
+            else
+                let b <- a;
+                let c <- a
+            fi;
+            call OutputNum(b * 2 - c * 2 + b)
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(count(main, InstrType::PHI), 2);
+    EXPECT_EQ(count(main, InstrType::MUL), 2);
+
+    p->optimize();
+    EXPECT_EQ(count(main, InstrType::PHI), 1);
+    EXPECT_EQ(count(main, InstrType::MUL), 1);
+    EXPECT_EQ(run(*p, "4"), "5");
+    EXPECT_EQ(run(*p, "-4"), "-4");
+}
+
+TEST(GVN, RedundantCompare)
+{
+    auto p = parse(R"(
+        main
+        var a, b, s; {
+            let a <- call InputNum;
+            let b <- call InputNum;
+            let s <- 0;
+            if a < b then
+                let s <- s + 1
+            fi;
+            if a < b then
+                let s <- s + 10
+            fi;
+            call OutputNum(s)
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(count(main, InstrType::CMP), 2);
+
+    p->optimize();
+    EXPECT_EQ(count(main, InstrType::CMP), 1);
+    EXPECT_EQ(run(*p, "1 2"), "11");
+    EXPECT_EQ(run(*p, "2 1"), "0");
+}
+
+// neither branch dominates the other or the join, every product stays
+TEST(GVN, SiblingBranchesKeepTheirValues)
+{
+    auto p = parse(R"(
+        main
+        var a, b, c; {
+            let a <- call InputNum;
+            let b <- call InputNum;
+            if a < b then
+                let c <- a * b
+            else
+                let c <- a * b + 1
+            fi;
+            call OutputNum(c + a * b)
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    p->optimize();
+    EXPECT_EQ(count(main, InstrType::MUL), 3);
+    EXPECT_EQ(run(*p, "2 3"), "12");
+    EXPECT_EQ(run(*p, "3 2"), "13");
+}
+
+// the loop tests i < n at the top and again in the body, the inner test is
+// dominated by the header and reuses its compare
+TEST(GVN, CompareDominatedByLoopHeader)
+{
+    auto p = parse(R"(
+        main
+        var n, i, s; {
+            let n <- call InputNum;
+            let s <- 0;
+            let i <- 0;
+            while i < n do
+                if i < n then
+                    let s <- s + i
+                fi;
+                let i <- i + 1
+            od;
+            call OutputNum(s)
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(count(main, InstrType::CMP), 2);
+    p->optimize();
+    EXPECT_EQ(count(main, InstrType::CMP), 1);
+    EXPECT_EQ(run(*p, "5"), "10");
+}
@@ -0,0 +1,68 @@
+#include "test_common.h"
+
+#include "loop.h"
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+TEST(Induction, ReducesMultiplyAndExactDivide)
+{
+    auto p = parse_optimized(R"(
+        main
+        var px, x;
+        {
+            let px <- 0;
+            while px < 5 do
+                let x <- ((px - 100) * 4 * 10000) / 200;
+                call OutputNum(x);
+                call OutputNewLine;
+                let px <- px + 1
+            od
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(in_loops(main, InstrType::MUL), 0);
+    EXPECT_EQ(in_loops(main, InstrType::DIV), 0);
+    // the test moved onto the recurrence, px is gone
+    EXPECT_EQ(in_loops(main, InstrType::PHI), 1);
+    EXPECT_EQ(run(*p, ""), "-20000\n-19800\n-19600\n-19400\n-19200\n");
+}
+
+TEST(Induction, CountsDown)
+{
+    auto p = parse_optimized(R"(
+        main
+        var i;
+        {
+            let i <- 10;
+            while i > 0 do
+                call OutputNum(i * 3);
+                let i <- i - 2
+            od
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(in_loops(main, InstrType::MUL), 0);
+    EXPECT_EQ(run(*p, ""), "302418126");
+}
+
+TEST(Induction, UnknownStart)
+{
+    auto p = parse_optimized(R"(
+        main
+        var i, n;
+        {
+            let i <- call InputNum;
+            let n <- call InputNum;
+            while i < n do
+                call OutputNum(i * 7 / 7);
+                let i <- i + 1
+            od
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(in_loops(main, InstrType::MUL), 0);
+    // the range is unknown so the division may not be exact
+    EXPECT_EQ(in_loops(main, InstrType::DIV), 1);
+    EXPECT_EQ(run(*p, "2 5"), "234");
+}
@@ -0,0 +1,112 @@
+#include "test_common.h"
+
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+TEST(Inline, FoldsAcrossTheCall)
+{
+    auto p = parse_optimized(R"(
+        main
+        var x;
+        function add(a, b); { return a + b };
+        {
+            let x <- call add(1, 2);
+            call OutputNum(x)
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(count(main, InstrType::JUMP), 0);
+    EXPECT_EQ(count(main, InstrType::SETP), 0);
+    EXPECT_EQ(count(main, InstrType::ADD), 0);
+    EXPECT_EQ(run(*p, ""), "3");
+}
+
+TEST(Inline, NestedCallsAndLoops)
+{
+    auto p = parse_optimized(R"(
+        main
+        var i, s;
+        function sq(a); { return a * a };
+        function sum(n); var i, s; {
+            let i <- 0;
+            let s <- 0;
+            while i < n do
+                let s <- s + call sq(i);
+                let i <- i + 1
+            od;
+            return s
+        };
+        {
+            let i <- 0;
+            while i < 3 do
+                call OutputNum(call sum(call sq(call InputNum)));
+                let i <- i + 1
+            od
+        }.
+    )");
+    for (auto& ssa : p->get_ir())
+        EXPECT_EQ(count(ssa, InstrType::JUMP), 0);
+    EXPECT_EQ(run(*p, "1 2 3"), "014204"); // squares below 1, 4 and 9
+}
+
+TEST(Inline, KeepsRecursion)
+{
+    auto p = parse_optimized(R"(
+        main
+        function fib(n); {
+            if n <= 1 then
+                return n
+            fi;
+            return call fib(n - 1) + call fib(n - 2)
+        };
+        {
+            call OutputNum(call fib(call InputNum))
+        }.
+    )");
+    EXPECT_EQ(count(p->get_ir().front(), InstrType::JUMP), 1);
+    EXPECT_EQ(run(*p, "10"), "55");
+}
+
+// the returns meet in a phi where the call was, with three of them through a
+// join in between
+TEST(Inline, JoinsReturns)
+{
+    auto p = parse_optimized(R"(
+        main
+        var x, y;
+        function max(a, b); {
+            if a > b then
+                return a
+            else
+                return b
+            fi
+        };
+        function abs(a); {
+            if a < 0 then
+                return 0 - a
+            fi;
+            return a
+        };
+        function sign(a); {
+            if a < 0 then
+                return 0 - 1
+            fi;
+            if a > 0 then
+                return 1
+            fi;
+            return 0
+        };
+        {
+            let x <- call InputNum;
+            let y <- call InputNum;
+            call OutputNum(call max(x, y));
+            call OutputNum(call abs(x));
+            call OutputNum(call sign(y))
+        }.
+    )");
+    EXPECT_EQ(count(p->get_ir().front(), InstrType::JUMP), 0);
+    EXPECT_EQ(run(*p, "-4 3"), "341");
+    EXPECT_EQ(run(*p, "5 -7"), "55-1");
+    EXPECT_EQ(run(*p, "0 0"), "000");
+}
@@ -0,0 +1,117 @@
+#include "test_common.h"
+
+#include "jit.h"
+#include "parser.h"
+#include "token.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+// the output up to a runtime error, then the error
+static std::string run_jit(Parser& p, std::string input = "")
+{
+    X86 x86(p.get_ir(), p.get_functions());
+    JIT jit(x86);
+    EXPECT_GT(jit.size(), 0);
+
+    input += " "; // fmemopen does not accept empty buffers
+    std::FILE* in = fmemopen(input.data(), input.size(), "r");
+    std::FILE* out = std::tmpfile();
+    std::string error;
+    try {
+        jit.run(in, out);
+    } catch (const std::runtime_error& e) {
+        error = e.what();
+    }
+
+    std::string res(std::ftell(out), '\0');
+    std::rewind(out);
+    EXPECT_EQ(std::fread(res.data(), 1, res.size(), out), res.size());
+    std::fclose(in);
+    std::fclose(out);
+    return error.empty() ? res : res + "[" + error + "]";
+}
+
+TEST(JIT, If)
+{
+    EXPECT_EQ(run_jit(*parse(GET_INTERMEDIATE("if.ty")), "1"), "2");
+    EXPECT_EQ(run_jit(*parse(GET_INTERMEDIATE("if2.ty")), "7"), "77");
+    EXPECT_EQ(run_jit(*parse(GET_INTERMEDIATE("commutativeCSE.tiny")), "10 6 3 4"), "7272");
+}
+
+TEST(JIT, While)
+{
+    EXPECT_EQ(run_jit(*parse(GET_COMPLEX("nested_while.tiny")), "10 6"), "654");
+    EXPECT_EQ(run_jit(*parse(GET_COMPLEX("complex.ty")), "0"), "10");
+}
+
+TEST(JIT, Functions)
+{
+    EXPECT_EQ(run_jit(*parse(GET_COMPLEX("fibonacci.ty")), "20"), "6765\n");
+    EXPECT_EQ(run_jit(*parse(GET_COMPLEX("gcd.tiny"))), "11\n");
+}
+
+TEST(JIT, Mandelbrot)
+{
+    auto out = run_jit(*parse(GET_COMPLEX("mandelbrot.tiny")));
+    EXPECT_EQ(std::count(out.begin(), out.end(), '\n'), 200);
+    EXPECT_EQ(out.size(), 201 * 200);
+}
+
+TEST(JIT, StackArgumentsAndWideConstants)
+{
+    std::string s = R"(
+        main
+        function f(a, b, c, d, e, g, h, i); {
+            return a - b + c - d + e - g + h * i
+        };
+        {
+            call OutputNum(call f(1, 2, 3, 4, 5, 6, 7, 8));
+            call OutputNum(10000000000 / 3 + 10000000000 * 2)
+        }.
+    )";
+    EXPECT_EQ(run_jit(*parse(s)), "5323333333333");
+}
+
+TEST(JIT, RuntimeErrorsReturnToTheCaller)
+{
+    std::string s = "main var x; { call OutputNum(1); let x <- call InputNum; call OutputNum(x) }.";
+    EXPECT_EQ(run_jit(*parse(s), "abc"), "1[failed to read input]");
+    // the host goes on and can run again
+    EXPECT_EQ(run_jit(*parse(s), "2"), "12");
+}
+
+// the cases idiv traps on behave as in the vm
+TEST(JIT, Division)
+{
+    std::string s = "main var x, y; { let x <- call InputNum; let y <- call InputNum; call OutputNum(x / y) }.";
+    EXPECT_EQ(run_jit(*parse(s), "-7 2"), "-3");
+    EXPECT_EQ(run_jit(*parse(s), "7 -1"), "-7");
+    EXPECT_EQ(run_jit(*parse(s), "-9223372036854775808 -1"), "-9223372036854775808");
+    EXPECT_EQ(run_jit(*parse(s), "7 0"), "[division by zero]");
+    std::string c = "main var x; { let x <- call InputNum; call OutputNum(x / (0 - 1)); call OutputNum(x / 0) }.";
+    EXPECT_EQ(run_jit(*parse(c), "-9223372036854775808"), "-9223372036854775808[division by zero]");
+}
+
+// a cmp shared by two branches is not fused, a - b would overflow
+TEST(JIT, SharedCompare)
+{
+    std::string s = R"(
+        main
+        var a, b; {
+            let a <- call InputNum();
+            let b <- call InputNum();
+            if a < b then call OutputNum(1) fi;
+            if a < b then call OutputNum(2) fi
+        }.
+    )";
+    EXPECT_EQ(run_jit(*parse(s, true), "9223372036854775807 -1"), "");
+    EXPECT_EQ(run_jit(*parse(s, true), "-9223372036854775808 1"), "12");
+    EXPECT_EQ(run_jit(*parse(s, true), "3 3"), "");
+
+    // and agrees with the vm
+    auto p = parse_optimized(s);
+    for (std::string input : { "9223372036854775807 -1", "-9223372036854775808 1", "3 3" })
+        EXPECT_EQ(run_jit(*p, input), run(*p, input)) << input;
+}
+
+#endif
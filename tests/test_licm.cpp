@@ -0,0 +1,86 @@
+#include "test_common.h"
+
+#include "loop.h"
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+TEST(LICM, HoistsOutOfNestedLoops)
+{
+    auto p = parse_optimized(R"(
+        main
+        var a, b, i, j, s;
+        {
+            let a <- call InputNum;
+            let b <- call InputNum;
+            let s <- 0;
+            let i <- 0;
+            while i < 4 do
+                let j <- 0;
+                while j < 3 do
+                    let s <- s + a * b - (i + 1) * a;
+                    let j <- j + 1
+                od;
+                let i <- i + 1
+            od;
+            call OutputNum(s)
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(in_loops(main, InstrType::MUL), 1); // (i + 1) * a
+    EXPECT_EQ(in_loops(main, InstrType::SUB), 1);
+
+    // a * b left both loops, (i + 1) * a only the inner one
+    const Loop& inner = *main.loops().get_loops()[0].children[0];
+    for (auto* b : inner.blocks)
+        for (auto& instr : b->get_instructions())
+            EXPECT_NE(instr.type, InstrType::MUL);
+    EXPECT_EQ(run(*p, "5 7"), "270");
+}
+
+TEST(LICM, KeepsDivisionThatCanTrap)
+{
+    auto p = parse_optimized(R"(
+        main
+        var a, b, i, s;
+        {
+            let a <- call InputNum;
+            let b <- call InputNum;
+            let s <- 0;
+            let i <- 0;
+            while i < 3 do
+                if b != 0 then
+                    let s <- s + a / b
+                fi;
+                let s <- s + a / 3;
+                let i <- i + 1
+            od;
+            call OutputNum(s)
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(in_loops(main, InstrType::DIV), 1);
+    EXPECT_EQ(run(*p, "9 0"), "9");
+    EXPECT_EQ(run(*p, "9 3"), "18");
+}
+
+TEST(LICM, HoistsDivisionFromTheHeader)
+{
+    auto p = parse_optimized(R"(
+        main
+        var a, b, i;
+        {
+            let a <- call InputNum;
+            let b <- call InputNum;
+            let i <- 0;
+            while i < a / b do
+                call OutputNum(i);
+                let i <- i + 1
+            od
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(in_loops(main, InstrType::DIV), 0);
+    EXPECT_EQ(run(*p, "7 2"), "012");
+    EXPECT_THROW(run(*p, "7 0"), std::runtime_error);
+}
@@ -0,0 +1,67 @@
+#include "test_common.h"
+
+#include "loop.h"
+#include "parser.h"
+#include "token.h"
+
+TEST(LoopNest, Nesting)
+{
+    auto p = parse(R"(
+        main
+        var i, j, k;
+        {
+            let i <- 0;
+            while i < 3 do
+                let j <- 0;
+                while j < 3 do
+                    let k <- 0;
+                    while k < 3 do
+                        let k <- k + 1
+                    od;
+                    let j <- j + 1
+                od;
+                let j <- 0;
+                while j < 2 do
+                    let j <- j + 1
+                od;
+                let i <- i + 1
+            od;
+            while i > 0 do
+                let i <- i - 1
+            od
+        }.
+    )");
+    auto& ssa = p->get_ir().front();
+    auto& loops = ssa.loops().get_loops();
+    ASSERT_EQ(loops.size(), 5);
+
+    const Loop& outer = loops[0];
+    EXPECT_EQ(outer.parent, nullptr);
+    EXPECT_EQ(outer.depth, 1);
+    ASSERT_EQ(outer.children.size(), 2);
+    EXPECT_EQ(outer.blocks.front(), outer.header);
+    EXPECT_EQ(outer.latches.size(), 1);
+
+    const Loop* first = outer.children[0];
+    EXPECT_EQ(first->parent, &outer);
+    ASSERT_EQ(first->children.size(), 1);
+    const Loop* innermost = first->children[0];
+    EXPECT_EQ(innermost->depth, 3);
+    EXPECT_TRUE(innermost->children.empty());
+    EXPECT_TRUE(outer.contains(innermost->header));
+    EXPECT_TRUE(first->contains(innermost->header));
+    EXPECT_FALSE(innermost->contains(first->header));
+    EXPECT_FALSE(outer.children[1]->contains(innermost->header));
+    EXPECT_EQ(ssa.loops().loop_of(innermost->header), innermost);
+    EXPECT_EQ(ssa.loops().loop_of(innermost->latches[0]), innermost);
+
+    const Loop& last = loops[4];
+    EXPECT_EQ(last.parent, nullptr);
+    EXPECT_FALSE(outer.contains(last.header));
+    EXPECT_EQ(ssa.loops().loop_of(ssa.get_head()), nullptr);
+
+    // every block of a loop is dominated by its header
+    for (auto& loop : loops)
+        for (auto* b : loop.blocks)
+            EXPECT_TRUE(ssa.dominators().dominates(loop.header, b));
+}
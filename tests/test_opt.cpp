@@ -0,0 +1,17 @@
+#include "test_common.h"
+
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+class OptimizeTest : public testing::TestWithParam<std::filesystem::path> { };
+
+TEST_P(OptimizeTest, MatchesUnoptimized)
+{
+    std::string input = "10 6 3 4 5 7 8 9 1 2 3";
+    EXPECT_EQ(run(*parse(GetParam(), true), input), run(*parse(GetParam()), input));
+}
+
+INSTANTIATE_TEST_SUITE_P(BasicSuite, OptimizeTest, testing::ValuesIn(getFiles(BASIC_TESTS)));
+INSTANTIATE_TEST_SUITE_P(IntermediateSuite, OptimizeTest, testing::ValuesIn(getFiles(INTERMEDIATE_TESTS)));
+INSTANTIATE_TEST_SUITE_P(ComplexSuite, OptimizeTest, testing::ValuesIn(getFiles(COMPLEX_TESTS)));
@@ -71,3 +71,19 @@ std::vector<std::filesystem::path> getFiles(std::string folder)
     }
     return files;
 }
+
+// errors the parser can not go on from end the parse instead of the process
+TEST(BasicParserTest, FatalErrorsAreCounted)
+{
+    for (const char* s : {
+             "main var x; { let y <- 1 }.",
+             "main var x; { let x <- y }.",
+             "main function f(a); { return a }; { call f(1, 2) }.",
+             "main var x; void function f(); { }; { let x <- call f }.",
+         }) {
+        TokenList toks;
+        ASSERT_TRUE(toks.tokenize(std::string(s)));
+        Parser p(std::move(toks));
+        EXPECT_EQ(p.parse(), 1) << s;
+    }
+}
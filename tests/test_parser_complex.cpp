@@ -18,6 +18,88 @@ TEST_P(ComplexParserTestSuite, Files)
     EXPECT_EQ(errors, 0);
 }
 
+// instruction types of every function in block order
+static std::vector<InstrType> shape(Parser& p)
+{
+    std::vector<InstrType> types;
+    for (auto& ssa : p.get_ir())
+        for (auto* b : ssa.reverse_post_order())
+            for (auto& instr : b->get_instructions())
+                types.push_back(instr.type);
+    return types;
+}
+
+TEST_P(ComplexParserTestSuite, Streaming)
+{
+    TokenList all, streamed;
+    ASSERT_TRUE(all.tokenize(GetParam()));
+    ASSERT_TRUE(streamed.stream(GetParam()));
+
+    Parser p(std::move(all)), q(std::move(streamed));
+    ASSERT_EQ(p.parse(), 0);
+    ASSERT_EQ(q.parse(), 0);
+    EXPECT_EQ(shape(p), shape(q));
+}
+
+static std::string dump(Parser& p)
+{
+    std::ostringstream os;
+    for (auto& ssa : p.get_ir())
+        os << ssa;
+    return os.str();
+}
+
+TEST_P(ComplexParserTestSuite, Parallel)
+{
+    TokenList toks;
+    ASSERT_TRUE(toks.tokenize(GetParam()));
+    TokenList copy = toks;
+
+    Parser p(std::move(toks)), q(std::move(copy));
+    ASSERT_EQ(p.parse(), 0);
+    ASSERT_EQ(q.parse(4), 0);
+    EXPECT_EQ(dump(p), dump(q));
+}
+
 INSTANTIATE_TEST_SUITE_P(ParserSuite, ComplexParserTestSuite, testing::ValuesIn(getFiles(COMPLEX_TESTS)));
 
+// Loops and ifs over 16 variables, the loop body repeats an expression of
+// values it never changes. Removing the trivial phis of every loop makes that
+// copy a common subexpression of the one in front of the loop.
+static std::string nested_program(size_t statements)
+{
+    std::string s = "main var i, t, u";
+    for (int v = 0; v < 16; v++)
+        s += ", v" + std::to_string(v);
+    s += "; {";
+    for (size_t k = 0; k * 7 < statements; k++) {
+        auto a = "v" + std::to_string(k % 16), b = "v" + std::to_string((k + 1) % 16), c = "v" + std::to_string((k + 2) % 16);
+        s += "let " + a + " <- " + b + " + " + c + "; let i <- 0; while i < 2 do let t <- " + b + " + " + c + "; ";
+        s += "if t < " + a + " then let u <- " + b + " * " + c + " else let u <- " + b + " + " + c + " fi; let i <- i + 1 od; ";
+    }
+    return s + "call OutputNum(v0) }.";
+}
+
+// readers visited by replace_uses over the whole program
+static u64 use_visits(const std::string& s)
+{
+    TokenList toks;
+    EXPECT_TRUE(toks.tokenize(s));
+    Parser p(std::move(toks));
+    EXPECT_EQ(p.parse(), 0);
+    u64 visits = 0;
+    for (auto& ssa : p.get_ir())
+        visits += ssa.get_use_visits();
+    return visits;
+}
+
+TEST(ComplexParserTest, LinearInStatements)
+{
+    u64 small = use_visits(nested_program(500));
+    u64 large = use_visits(nested_program(2000));
+    // four times the statements, about four times the work
+    EXPECT_GT(small, 0u);
+    EXPECT_LE(large, 5 * small);
+}
+
 #endif
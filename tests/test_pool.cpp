@@ -0,0 +1,37 @@
+#include "test_common.h"
+
+#include "pool.h"
+
+TEST(ThreadPool, RunsEveryTask)
+{
+    for (unsigned jobs : { 1u, 4u }) {
+        ThreadPool pool(jobs);
+        EXPECT_EQ(pool.jobs(), jobs);
+        std::vector<int> done(1000);
+        for (size_t i = 0; i < done.size(); i++)
+            pool.submit([&done, i]() { done[i]++; });
+        pool.wait();
+        EXPECT_EQ(std::count(done.begin(), done.end(), 1), 1000);
+    }
+}
+
+// tasks queued by tasks are waited for as well
+TEST(ThreadPool, NestedTasks)
+{
+    ThreadPool pool(3);
+    std::atomic<int> count = 0;
+    std::function<void(int)> split = [&](int depth) {
+        count++;
+        if (depth)
+            for (int i = 0; i < 2; i++)
+                pool.submit([&split, depth]() { split(depth - 1); });
+    };
+    pool.submit([&]() { split(9); });
+    pool.wait();
+    EXPECT_EQ(count, (1 << 10) - 1);
+
+    // and the pool is reused after waiting
+    pool.submit([&]() { count = 0; });
+    pool.wait();
+    EXPECT_EQ(count, 0);
+}
@@ -0,0 +1,78 @@
+#include "test_common.h"
+
+#include "jit.h"
+#include "parser.h"
+#include "regalloc.h"
+#include "token.h"
+#include "vm.h"
+
+// twenty variables live across a loop with calls and a swap
+static const char* pressure = R"(
+    main
+    var a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, q, r, s, t;
+
+    function mix(a, b, c, d, e, f, g, h); var t; {
+        let t <- 0;
+        while a > 0 do
+            let t <- t + a * b - c + d * e - f + g * h;
+            let a <- a - 1;
+            let b <- c; let c <- d; let d <- b;
+        od;
+        return t
+    };
+
+    {
+        let a <- call InputNum(); let b <- call InputNum(); let c <- call InputNum();
+        let d <- a + b; let e <- b + c; let f <- c + d; let g <- d + e; let h <- e + f;
+        let i <- f + g; let j <- g + h; let k <- h + i; let l <- i + j; let m <- j + k;
+        let n <- k + l; let o <- l + m; let p <- m + n; let q <- n + o; let r <- o + p;
+        let s <- 0; let t <- 0;
+        while t < 5 do
+            let s <- s + a + b + c + d + e + f + g + h + i + j + k + l + m + n + o + p + q + r;
+            let a <- b; let b <- a;
+            call OutputNum(s); call OutputNewLine();
+            let q <- call mix(t, a, b, c, d, e, f, g) + q / (t + 1);
+            let t <- t + 1
+        od;
+        call OutputNum(a + b + c + d + e + f + g + h + i + j + k + l + m + n + o + p + q + r + s + t)
+    }.
+)";
+
+TEST(RegAlloc, MandelbrotInRegisters)
+{
+    TokenList toks;
+    EXPECT_TRUE(toks.tokenize(std::filesystem::path(GET_COMPLEX("mandelbrot.tiny"))));
+    Parser p(std::move(toks));
+    EXPECT_EQ(p.parse(), 0);
+    for (const auto& ssa : p.get_ir())
+        EXPECT_EQ(RegAlloc(ssa.reverse_post_order()).get_spill_slots(), 0) << ssa.name;
+}
+
+TEST(RegAlloc, Spills)
+{
+    auto p = parse(pressure);
+    EXPECT_GT(RegAlloc(p->get_ir().front().reverse_post_order()).get_spill_slots(), 0);
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+
+TEST(RegAlloc, SpilledCodeMatchesVM)
+{
+    auto p = parse(pressure);
+    std::string input = "3 4 5 ";
+
+    JIT jit(X86(p->get_ir(), p->get_functions()));
+    std::FILE* in = fmemopen(input.data(), input.size(), "r");
+    std::FILE* out = std::tmpfile();
+    jit.run(in, out);
+
+    std::string res(std::ftell(out), '\0');
+    std::rewind(out);
+    EXPECT_EQ(std::fread(res.data(), 1, res.size(), out), res.size());
+    std::fclose(in);
+    std::fclose(out);
+
+    EXPECT_EQ(res, run(*p, input));
+}
+
+#endif
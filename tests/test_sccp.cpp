@@ -0,0 +1,77 @@
+#include "test_common.h"
+
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+static bool is_arith(InstrType type)
+{
+    return type == InstrType::ADD || type == InstrType::SUB || type == InstrType::MUL || type == InstrType::DIV || type == InstrType::CMP;
+}
+
+TEST(SCCP, FoldsArithmetic)
+{
+    auto p = parse_optimized("main { call OutputNum(4 * 10000 * 10000 - 7 / 2 + (1 - 2) * 3) }.");
+    EXPECT_EQ(count(p->get_ir().front(), is_arith), 0);
+    EXPECT_EQ(run(*p), "399999994");
+}
+
+TEST(SCCP, FoldsBranches)
+{
+    auto p = parse_optimized(R"(
+        main
+        var x;
+        {
+            let x <- call InputNum;
+            if 1 < 2 then
+                call OutputNum(x)
+            else
+                call OutputNum(x * 2)
+            fi;
+            while 0 > 1 do
+                let x <- x + 1
+            od;
+            call OutputNum(x)
+        }.
+    )");
+    auto& main = p->get_ir().front();
+    EXPECT_EQ(count(main, isBranch), 0);
+    EXPECT_EQ(count(main, is_arith), 0);
+    EXPECT_EQ(count(main, [](InstrType t) { return t == InstrType::PHI; }), 0);
+    EXPECT_EQ(run(*p, "5"), "55");
+}
+
+TEST(SCCP, ThroughPhis)
+{
+    auto p = parse_optimized(R"(
+        main
+        var a, b, i;
+        {
+            let b <- call InputNum;
+            let a <- 3;
+            if b > 0 then
+                let a <- 1 + 2
+            fi;
+            let i <- 0;
+            while i < b do
+                let a <- a * 1;
+                let i <- i + 1
+            od;
+            if a != 3 then
+                call OutputNum(b)
+            fi;
+            call OutputNum(a * 5 + i)
+        }.
+    )");
+    // a is 3 on every path, only the tests on b, the loop counter and the final add are left
+    EXPECT_EQ(count(p->get_ir().front(), is_arith), 4);
+    EXPECT_EQ(count(p->get_ir().front(), isBranch), 2);
+    EXPECT_EQ(run(*p, "4"), "19");
+    EXPECT_EQ(run(*p, "0"), "15");
+}
+
+TEST(SCCP, KeepsDivisionByZero)
+{
+    auto p = parse_optimized("main { call OutputNum(1 / 0) }.");
+    EXPECT_THROW(run(*p), std::runtime_error);
+}
@@ -0,0 +1,194 @@
+#include "test_common.h"
+
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+#include "parser.h"
+#include "server.h"
+
+#define PROGRAM "main var x; { let x <- call InputNum; call OutputNum(x * 2 + 1) }."
+
+class ServerTest : public testing::Test {
+protected:
+    std::filesystem::path socket;
+    std::unique_ptr<Server> server;
+    std::thread thread;
+
+    void start(const ServeOptions& options)
+    {
+        server = std::make_unique<Server>(socket, options);
+        thread = std::thread([this]() { EXPECT_TRUE(server->run()); });
+        // the socket is there once the server listens
+        for (int i = 0; i < 1000; i++) {
+            ServeClient client;
+            if (client.connect(socket))
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        FAIL() << "server did not come up";
+    }
+
+    // ctest runs the tests of a suite side by side, every one has a socket of its own
+    void SetUp() override
+    {
+        auto name = testing::UnitTest::GetInstance()->current_test_info()->name();
+        socket = std::filesystem::temp_directory_path() / ("ty_server_" + std::to_string(getpid()) + "_" + name + ".sock");
+    }
+
+    void TearDown() override
+    {
+        if (server)
+            server->stop();
+        if (thread.joinable())
+            thread.join();
+        std::filesystem::remove(socket);
+    }
+};
+
+TEST_F(ServerTest, Outputs)
+{
+    ServeOptions options;
+    options.jobs = 2;
+    start(options);
+
+    TokenList toks;
+    ASSERT_TRUE(toks.tokenize(std::string(PROGRAM)));
+    Parser p(std::move(toks));
+    ASSERT_EQ(p.parse(), 0);
+    p.optimize();
+    std::ostringstream dot;
+    p.generate_dot(dot);
+
+    ServeClient client;
+    ASSERT_TRUE(client.connect(socket));
+    // requests one after the other on one connection
+    auto response = client.compile(PROGRAM, ServeOutput::DOT);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::OK);
+    EXPECT_EQ(response->second, dot.str());
+
+    response = client.compile(PROGRAM, ServeOutput::ASM);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::OK);
+    EXPECT_NE(response->second.find("main:"), std::string::npos) << response->second;
+
+    response = client.compile(PROGRAM, ServeOutput::IR, false);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::OK);
+    EXPECT_NE(response->second.find("mul"), std::string::npos) << response->second;
+
+    // a bad program is an error and the server goes on
+    response = client.compile("main var x; { let y <- 1 }.", ServeOutput::DOT);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::ERROR);
+    EXPECT_NE(response->second.find("Unknown symbol 'y'"), std::string::npos) << response->second;
+    response = client.compile(PROGRAM, ServeOutput::DOT);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::OK);
+}
+
+TEST_F(ServerTest, ConcurrentClients)
+{
+    ServeOptions options;
+    options.jobs = 3;
+    start(options);
+
+    std::vector<std::thread> clients;
+    std::atomic<int> ok = 0;
+    for (int c = 0; c < 6; c++) {
+        clients.emplace_back([&]() {
+            ServeClient client;
+            if (!client.connect(socket))
+                return;
+            for (int i = 0; i < 20; i++) {
+                auto response = client.compile(PROGRAM, ServeOutput::ASM);
+                ok += response && response->first == ServeStatus::OK;
+            }
+        });
+    }
+    for (auto& t : clients)
+        t.join();
+    EXPECT_EQ(ok, 120);
+}
+
+TEST_F(ServerTest, IdleConnectionsHoldNoThread)
+{
+    ServeOptions options;
+    options.jobs = 1;
+    start(options);
+
+    ServeClient idle[3], client;
+    for (auto& c : idle)
+        ASSERT_TRUE(c.connect(socket));
+    ASSERT_TRUE(client.connect(socket));
+    auto response = client.compile(PROGRAM, ServeOutput::ASM);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::OK);
+
+    // and the idle ones are served once they ask
+    for (auto& c : idle) {
+        response = c.compile(PROGRAM, ServeOutput::IR);
+        ASSERT_TRUE(response);
+        EXPECT_EQ(response->first, ServeStatus::OK);
+    }
+}
+
+TEST_F(ServerTest, Budgets)
+{
+    ServeOptions options;
+    options.budget_bytes = 4 << 20;
+    options.budget_time = std::chrono::seconds(60); // only memory runs out
+    options.max_source = 2 << 20;
+    start(options);
+
+    std::string big = "main var x; {";
+    for (int i = 0; i < 40000; i++)
+        big += "let x <- x * " + std::to_string(i) + " + call InputNum; ";
+    big += "call OutputNum(x) }.";
+
+    ServeClient client;
+    ASSERT_TRUE(client.connect(socket));
+    auto response = client.compile(big, ServeOutput::ASM);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::BUDGET);
+    EXPECT_EQ(response->second, "memory budget exceeded");
+
+    // small requests still fit
+    response = client.compile(PROGRAM, ServeOutput::ASM);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::OK);
+
+    // too large to read, the server answers and hangs up
+    response = client.compile(std::string(3 << 20, ' '), ServeOutput::ASM);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::BUDGET);
+    EXPECT_FALSE(client.compile(PROGRAM, ServeOutput::ASM));
+}
+
+TEST_F(ServerTest, TimeBudget)
+{
+    ServeOptions options;
+    options.budget_time = std::chrono::milliseconds(0);
+    start(options);
+
+    std::string big = "main var x; {";
+    for (int i = 0; i < 2000; i++)
+        big += "let x <- x + " + std::to_string(i) + "; ";
+    big += "call OutputNum(x) }.";
+
+    ServeClient client;
+    ASSERT_TRUE(client.connect(socket));
+    auto response = client.compile(big, ServeOutput::DOT);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->first, ServeStatus::BUDGET);
+    EXPECT_EQ(response->second, "time budget exceeded");
+}
+
+TEST_F(ServerTest, KeepsOtherFiles)
+{
+    std::ofstream(socket) << "not a socket";
+    Server other(socket, {});
+    EXPECT_FALSE(other.run());
+    EXPECT_TRUE(std::filesystem::is_regular_file(socket));
+}
@@ -0,0 +1,109 @@
+#include "test_common.h"
+
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+TEST(TailCall, BecomesALoop)
+{
+    auto p = parse_optimized(R"(
+        main
+        function gcd(a, b); {
+            if b == 0 then
+                return a
+            fi;
+            return call gcd(b, a - a / b * b)
+        };
+        {
+            call OutputNum(call gcd(call InputNum, call InputNum))
+        }.
+    )");
+    auto& gcd = p->get_ir()[1];
+    EXPECT_EQ(count(gcd, InstrType::JUMP), 0);
+    EXPECT_EQ(gcd.loops().get_loops().size(), 1);
+    EXPECT_EQ(run(*p, "84 36"), "12");
+}
+
+TEST(TailCall, Accumulator)
+{
+    auto p = parse_optimized(R"(
+        main
+        function sum(n); {
+            if n == 0 then
+                return 0
+            fi;
+            return n + call sum(n - 1)
+        };
+        function fact(n); {
+            if n <= 1 then
+                return 1
+            fi;
+            return n * call fact(n - 1)
+        };
+        {
+            call OutputNum(call sum(call InputNum));
+            call OutputNewLine;
+            call OutputNum(call fact(call InputNum))
+        }.
+    )");
+    for (auto& ssa : p->get_ir())
+        EXPECT_EQ(count(ssa, InstrType::JUMP), 0);
+    // far deeper than the vm stack allows for calls
+    EXPECT_EQ(run(*p, "10000000 10"), "50000005000000\n3628800");
+}
+
+TEST(TailCall, KeepsOtherCalls)
+{
+    auto p = parse_optimized(R"(
+        main
+        function fib(n); {
+            if n <= 1 then
+                return n
+            fi;
+            return call fib(n - 1) + call fib(n - 2)
+        };
+        {
+            call OutputNum(call fib(call InputNum))
+        }.
+    )");
+    // the second call folds into the loop, the first one stays
+    EXPECT_EQ(count(p->get_ir()[1], InstrType::JUMP), 1);
+    EXPECT_EQ(run(*p, "20"), "6765");
+}
+
+// the deep call is the second one in reverse post order, both become edges
+// to one latch
+TEST(TailCall, SeveralCallSites)
+{
+    auto p = parse_optimized(R"(
+        main
+        function f(n, a); {
+            if n < 3 then
+                if n > 0 then
+                    return call f(n - 1, a + 2)
+                else
+                    return a
+                fi
+            else
+                return call f(n - 1, a + 1)
+            fi
+        };
+        function g(n); {
+            if n == 0 then
+                return 0
+            fi;
+            if n < 5 then
+                return 2 + call g(n - 1)
+            fi;
+            return n + call g(n - 1)
+        };
+        {
+            call OutputNum(call f(call InputNum, 0));
+            call OutputNewLine;
+            call OutputNum(call g(call InputNum))
+        }.
+    )");
+    EXPECT_EQ(count(p->get_ir()[1], InstrType::JUMP), 0);
+    EXPECT_EQ(count(p->get_ir()[2], InstrType::JUMP), 0);
+    EXPECT_EQ(run(*p, "20000000 10000000"), "20000002\n50000004999998");
+}
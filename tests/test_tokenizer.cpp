@@ -139,3 +139,164 @@ TEST(Tokenizer, Basic)
         toks.eat();
     }
 }
+
+TEST(Tokenizer, IdentifiersPointIntoTheSource)
+{
+    std::string s = "let abc <- x1 // trailing comment without newline";
+    TokenList toks;
+    ASSERT_TRUE(toks.tokenize_view(s));
+    ASSERT_EQ(toks.size(), 4);
+
+    toks.eat();
+    EXPECT_EQ(toks.id(), "abc");
+    EXPECT_EQ(toks.id().data(), s.data() + 4);
+    toks.eat();
+    toks.eat();
+    EXPECT_EQ(toks.id(), "x1");
+    EXPECT_EQ(toks.id().data(), s.data() + 11);
+}
+
+// the copy of a string and the mapping of a file move along with the list
+TEST(Tokenizer, IdentifiersSurviveMoves)
+{
+    TokenList from_string;
+    ASSERT_TRUE(from_string.tokenize(std::string("a")));
+    TokenList moved(std::move(from_string));
+    EXPECT_EQ(moved.id(), "a");
+
+    TokenList from_file;
+    ASSERT_TRUE(from_file.tokenize(std::filesystem::path(GET_BASIC("add_with_output.ty"))));
+    TokenList file_moved(std::move(from_file));
+    while (file_moved.remaining() && file_moved.get_type() != TokenType::ID)
+        file_moved.eat();
+    ASSERT_TRUE(file_moved.remaining());
+    EXPECT_FALSE(file_moved.id().empty());
+}
+
+// runs longer than a vector register, split at every offset into it
+TEST(Tokenizer, LongRuns)
+{
+    std::string name = "aVeryLongIdentifierNameThatCrosses16ByteChunks";
+    std::string digits = "123456789012345678";
+    for (size_t pad = 0; pad < 20; pad++) {
+        std::string s = std::string(pad, ' ') + name + " \t\n\v\f\r" + std::string(pad, '\n') + digits + "//" + std::string(pad, 'x') + "\nfi";
+        TokenList toks;
+        ASSERT_TRUE(toks.tokenize(s));
+        ASSERT_EQ(toks.size(), 3);
+        EXPECT_EQ(toks.id(), name);
+        toks.eat();
+        EXPECT_EQ(toks.get_type(), TokenType::NUM);
+        EXPECT_EQ(toks.val(), 123456789012345678u);
+        toks.eat();
+        EXPECT_EQ(toks.get_type(), TokenType::FI);
+    }
+}
+
+TEST(Tokenizer, KeywordsAndNearMisses)
+{
+    std::string s = "main call void function return let var if then else fi while do od "
+                    "mains cal functio If odd whil";
+    TokenList toks;
+    ASSERT_TRUE(toks.tokenize(s));
+    for (int type = (int)TokenType::MAIN; type <= (int)TokenType::OD; type++) {
+        EXPECT_EQ(toks.get_type(), (TokenType)type);
+        toks.eat();
+    }
+    while (toks.remaining()) {
+        EXPECT_EQ(toks.get_type(), TokenType::ID);
+        toks.eat();
+    }
+}
+
+// bytes outside of ascii are no letters, the token runs to the next space
+TEST(Tokenizer, NonAscii)
+{
+    std::string s = "let x\xc3\xa9y <- 1";
+    TokenList toks;
+    ASSERT_FALSE(toks.tokenize(s));
+    toks.eat();
+    EXPECT_EQ(toks.id(), "x");
+    toks.eat();
+    EXPECT_EQ(toks.get_type(), TokenType::UNKNOWN);
+    EXPECT_EQ(toks.id(), "\xc3\xa9y");
+    toks.eat();
+    EXPECT_EQ(toks.get_type(), TokenType::ASSIGN);
+}
+
+// every list numbers its names on its own, first come first numbered after the builtins
+TEST(Tokenizer, IdsArePerList)
+{
+    TokenList first, second;
+    ASSERT_TRUE(first.tokenize(std::string("alpha beta alpha OutputNum")));
+    ASSERT_TRUE(second.tokenize(std::string("beta alpha")));
+
+    std::vector<u64> ids;
+    for (; first.remaining(); first.eat())
+        ids.push_back(*first.val());
+    EXPECT_EQ(ids, (std::vector<u64> { 3, 4, 3, 1 }));
+    EXPECT_EQ(second.val(), 3u);
+    second.eat();
+    EXPECT_EQ(second.val(), 4u);
+    EXPECT_EQ(second.id(), "alpha");
+}
+
+TEST(Tokenizer, WideNumbers)
+{
+    TokenList toks;
+    ASSERT_TRUE(toks.tokenize(std::string("4294967295 4294967296 18446744073709551615")));
+    EXPECT_EQ(toks.val(), 4294967295u);
+    toks.eat();
+    EXPECT_EQ(toks.val(), 4294967296u);
+    toks.eat();
+    EXPECT_EQ(toks.val(), 18446744073709551615u);
+}
+
+// the parser only ever sees the lookahead of a streaming list
+TEST(Tokenizer, StreamingMatchesTokenize)
+{
+    std::string s = "main var a, b; { let a <- call InputNum; let b <- 4294967296 * a; "
+                    "if a >= b then call OutputNum(a) else call OutputNum(b) fi // done\n }.";
+    for (int i = 0; i < 6; i++)
+        s += s; // longer than the lookahead
+
+    TokenList all, streamed;
+    ASSERT_TRUE(all.tokenize(s));
+    streamed.stream_view(s);
+    for (; all.remaining(); all.eat(), streamed.eat()) {
+        ASSERT_TRUE(streamed.remaining());
+        EXPECT_LE(streamed.remaining(), TOKEN_LOOKAHEAD);
+        ASSERT_EQ(streamed.get_type(), all.get_type());
+        EXPECT_EQ(streamed.val(), all.val());
+        EXPECT_EQ(streamed.id(), all.id());
+    }
+    EXPECT_EQ(streamed.remaining(), 0);
+    EXPECT_EQ(streamed.get(), nullptr);
+    EXPECT_EQ(streamed.size(), all.size());
+}
+
+// chunks are cut at spaces outside of comments, here the program is long
+// lines of code between many lines ending in comments
+TEST(Tokenizer, ParallelMatchesSerial)
+{
+    std::string line;
+    for (int i = 0; i < 4000; i++)
+        line += "let v" + std::to_string(i % 700) + " <- a" + std::to_string(i) + " * 4294967296 + 7; ";
+    std::string s = "main var a; {";
+    while (s.size() < 3 * TOKENIZE_CHUNK) {
+        s += line + "\n";
+        for (int i = 0; i < 2000; i++)
+            s += "let a <- 1 // a comment with spaces, # and a3 in it\n";
+        s += "\t$ x //\n";
+    }
+    s += "}.";
+
+    TokenList serial, parallel;
+    EXPECT_FALSE(serial.tokenize_view(s));
+    EXPECT_FALSE(parallel.tokenize_view(s, 4));
+    ASSERT_EQ(parallel.size(), serial.size());
+    for (; serial.remaining(); serial.eat(), parallel.eat()) {
+        ASSERT_EQ(parallel.get_type(), serial.get_type());
+        ASSERT_EQ(parallel.val(), serial.val());
+        ASSERT_EQ(parallel.id(), serial.id());
+    }
+}
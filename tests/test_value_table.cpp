@@ -0,0 +1,111 @@
+#include "test_common.h"
+
+#include "parser.h"
+#include "token.h"
+#include "value_table.h"
+#include "vm.h"
+
+static Instr expr(InstrType type, u64 x, u64 y)
+{
+    Instr instr = {};
+    instr.type = type;
+    instr.x = x;
+    instr.y = y;
+    return instr;
+}
+
+TEST(ValueTable, OnlyCommutativeOperandsSwap)
+{
+    ValueTable table;
+    table.insert(expr(InstrType::ADD, 1, 2), 10);
+    table.insert(expr(InstrType::SUB, 1, 2), 11);
+    table.insert(expr(InstrType::DIV, 1, 2), 12);
+    table.insert(expr(InstrType::MUL, 2, 1), 13);
+
+    EXPECT_EQ(table.find(expr(InstrType::ADD, 2, 1)), 10u);
+    EXPECT_EQ(table.find(expr(InstrType::SUB, 1, 2)), 11u);
+    EXPECT_EQ(table.find(expr(InstrType::SUB, 2, 1)), std::nullopt);
+    EXPECT_EQ(table.find(expr(InstrType::DIV, 2, 1)), std::nullopt);
+    EXPECT_EQ(table.find(expr(InstrType::MUL, 1, 2)), 13u);
+    EXPECT_EQ(table.find(expr(InstrType::ADD, 1, 1)), std::nullopt);
+
+    EXPECT_FALSE(expr(InstrType::SUB, 1, 2) == expr(InstrType::SUB, 2, 1));
+    EXPECT_TRUE(expr(InstrType::MUL, 1, 2) == expr(InstrType::MUL, 2, 1));
+}
+
+TEST(ValueTable, ScopesRollBack)
+{
+    ValueTable table;
+    table.insert(expr(InstrType::ADD, 1, 2), 10);
+    table.push_scope();
+    table.insert(expr(InstrType::ADD, 1, 2), 20); // shadows
+    table.insert(expr(InstrType::MUL, 3, 4), 21);
+    table.push_scope();
+    for (u64 i = 0; i < 1000; i++) // grows the table inside the scope
+        table.insert(expr(InstrType::SUB, i, i), 100 + i);
+    EXPECT_EQ(table.find(expr(InstrType::ADD, 2, 1)), 20u);
+    EXPECT_EQ(table.find(expr(InstrType::SUB, 500, 500)), 600u);
+    table.pop_scope();
+
+    EXPECT_EQ(table.size(), 2u);
+    EXPECT_EQ(table.find(expr(InstrType::SUB, 500, 500)), std::nullopt);
+    EXPECT_EQ(table.find(expr(InstrType::MUL, 4, 3)), 21u);
+    table.pop_scope();
+
+    EXPECT_EQ(table.size(), 1u);
+    EXPECT_EQ(table.find(expr(InstrType::ADD, 1, 2)), 10u);
+    EXPECT_EQ(table.find(expr(InstrType::MUL, 3, 4)), std::nullopt);
+}
+
+// a + b over every pair of a few values, the pattern the old xor hash folded
+// onto the same few buckets
+TEST(ValueTable, DenseOperands)
+{
+    ValueTable table;
+    u32 n = 0;
+    for (u64 a = 0; a < 200; a++)
+        for (u64 b = a; b < 200; b++)
+            table.insert(expr(InstrType::ADD, a, b), n++);
+    table.push_scope();
+    for (u64 a = 0; a < 200; a++)
+        for (u64 b = 0; b < 200; b++)
+            table.insert(expr(InstrType::SUB, a, b), n++);
+    table.pop_scope();
+
+    n = 0;
+    for (u64 a = 0; a < 200; a++)
+        for (u64 b = a; b < 200; b++)
+            ASSERT_EQ(table.find(expr(InstrType::ADD, b, a)), n++);
+    EXPECT_EQ(table.size(), 200u * 201 / 2);
+}
+
+// the product in the then branch must not stand in for the one after the join
+TEST(ValueTable, BranchExpressionsStayInTheBranch)
+{
+    std::string s = R"(
+        main
+        var a, b, c; {
+            let a <- call InputNum;
+            let b <- 3;
+            if a < 0 then
+                let c <- a * b
+            else
+                let c <- 0
+            fi;
+            while c < a * b do
+                let c <- c + a - b
+            od;
+            call OutputNum(c + a * b)
+        }.
+    )";
+    TokenList toks;
+    ASSERT_TRUE(toks.tokenize(s));
+    Parser p(std::move(toks));
+    ASSERT_EQ(p.parse(), 0);
+
+    VM vm(p.get_ir(), p.get_functions());
+    std::istringstream in("5");
+    std::ostringstream out;
+    vm.run(in, out);
+    EXPECT_EQ(out.str(), "31");
+}
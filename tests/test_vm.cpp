@@ -0,0 +1,95 @@
+#include "test_common.h"
+
+#include "parser.h"
+#include "token.h"
+#include "vm.h"
+
+TEST(VM, Basic)
+{
+    EXPECT_EQ(run(*parse(GET_BASIC("check_inbuilt.ty")), "41"), "42\n");
+    EXPECT_EQ(run(*parse(GET_BASIC("triple_add.ty"))), "3");
+}
+
+TEST(VM, If)
+{
+    EXPECT_EQ(run(*parse(GET_INTERMEDIATE("if.ty")), "1"), "2");
+    EXPECT_EQ(run(*parse(GET_INTERMEDIATE("if.ty")), "5"), "6");
+    EXPECT_EQ(run(*parse(GET_INTERMEDIATE("if2.ty")), "1"), "2");
+    EXPECT_EQ(run(*parse(GET_INTERMEDIATE("if2.ty")), "7"), "77");
+    EXPECT_EQ(run(*parse(GET_INTERMEDIATE("commutativeCSE.tiny")), "10 6 3 4"), "7272");
+}
+
+TEST(VM, While)
+{
+    EXPECT_EQ(run(*parse(GET_COMPLEX("while_if.ty"))), "10");
+    EXPECT_EQ(run(*parse(GET_COMPLEX("complex.ty")), "0"), "10");
+    EXPECT_EQ(run(*parse(GET_COMPLEX("nested_while.tiny")), "10 6"), "654");
+    EXPECT_EQ(run(*parse(GET_COMPLEX("nested_if_while.tny")), "10 6"), "106");
+}
+
+TEST(VM, Functions)
+{
+    EXPECT_EQ(run(*parse(GET_COMPLEX("add_func.ty"))), "3");
+    EXPECT_EQ(run(*parse(GET_COMPLEX("func_2x.ty"))), "2\n");
+    EXPECT_EQ(run(*parse(GET_COMPLEX("fibonacci.ty")), "10"), "55\n");
+    EXPECT_EQ(run(*parse(GET_COMPLEX("fibonacci.ty")), "20"), "6765\n");
+    EXPECT_EQ(run(*parse(GET_COMPLEX("gcd.tiny"))), "11\n");
+}
+
+TEST(VM, Mandelbrot)
+{
+    std::istringstream out(run(*parse(GET_COMPLEX("mandelbrot.tiny"))));
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(out, line);)
+        lines.push_back(line);
+
+    ASSERT_EQ(lines.size(), 200);
+    for (auto& line : lines)
+        EXPECT_EQ(line.size(), 200);
+    EXPECT_EQ(lines[0], std::string(200, '1'));
+    EXPECT_EQ(lines[100][100], '8'); // (0, 0) is in the set
+}
+
+TEST(VM, PhiSwap)
+{
+    std::string s = R"(
+        main
+        var a, b, t, i; {
+            let a <- 1;
+            let b <- 2;
+            let i <- 0;
+            while i < 3 do
+                let t <- a;
+                let a <- b;
+                let b <- t;
+                let i <- i + 1
+            od;
+            call OutputNum(a);
+            call OutputNum(b)
+        }.
+    )";
+    EXPECT_EQ(run(*parse(s)), "21");
+}
+
+TEST(VM, DeepRecursion)
+{
+    std::string s = R"(
+        main
+        function sum(n); {
+            if n == 0 then
+                return 0
+            fi;
+            return n + call sum(n - 1)
+        };
+        {
+            call OutputNum(call sum(call InputNum))
+        }.
+    )";
+    EXPECT_EQ(run(*parse(s), "100000"), "5000050000");
+}
+
+TEST(VM, DivisionByZero)
+{
+    std::string s = "main var x; { let x <- call InputNum; call OutputNum(1 / x) }.";
+    EXPECT_THROW(run(*parse(s), "0"), std::runtime_error);
+}
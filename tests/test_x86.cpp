@@ -0,0 +1,105 @@
+#include "test_common.h"
+
+#include "parser.h"
+#include "token.h"
+#include "x86.h"
+
+#include <fstream>
+#include <sys/wait.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+
+// assembles, links against the runtime and runs the program
+static std::string run_native(Parser& p, const std::string& input, const std::string& name, int status = 0)
+{
+    auto dir = std::filesystem::temp_directory_path();
+    auto asm_file = dir / ("ty_x86_" + name + ".s");
+    auto exe_file = dir / ("ty_x86_" + name);
+    auto in_file = dir / ("ty_x86_" + name + ".in");
+    auto out_file = dir / ("ty_x86_" + name + ".out");
+    {
+        std::ofstream os(asm_file);
+        X86(p.get_ir(), p.get_functions()).emit_asm(os);
+        std::ofstream(in_file) << input;
+    }
+
+    std::string cc = std::string(TY_CC) + " " + asm_file.string() + " " + TY_RUNTIME + " -o " + exe_file.string();
+    EXPECT_EQ(std::system(cc.c_str()), 0) << cc;
+    std::string cmd = exe_file.string() + " < " + in_file.string() + " > " + out_file.string();
+    EXPECT_EQ(WEXITSTATUS(std::system((cmd + " 2>/dev/null").c_str())), status) << cmd;
+
+    std::ifstream is(out_file);
+    std::stringstream ss;
+    ss << is.rdbuf();
+    return ss.str();
+}
+
+TEST(X86, If)
+{
+    EXPECT_EQ(run_native(*parse(GET_INTERMEDIATE("if.ty")), "1", "if"), "2");
+    EXPECT_EQ(run_native(*parse(GET_INTERMEDIATE("commutativeCSE.tiny")), "10 6 3 4", "commutativeCSE"), "7272");
+}
+
+TEST(X86, While)
+{
+    EXPECT_EQ(run_native(*parse(GET_COMPLEX("nested_while.tiny")), "10 6", "nested_while"), "654");
+}
+
+TEST(X86, Functions)
+{
+    EXPECT_EQ(run_native(*parse(GET_COMPLEX("fibonacci.ty")), "20", "fibonacci"), "6765\n");
+    EXPECT_EQ(run_native(*parse(GET_COMPLEX("gcd.tiny")), "", "gcd"), "11\n");
+}
+
+TEST(X86, Mandelbrot)
+{
+    auto out = run_native(*parse(GET_COMPLEX("mandelbrot.tiny")), "", "mandelbrot");
+    EXPECT_EQ(std::count(out.begin(), out.end(), '\n'), 200);
+    EXPECT_EQ(out.size(), 201 * 200);
+}
+
+TEST(X86, StackArguments)
+{
+    std::string s = R"(
+        main
+        function f(a, b, c, d, e, g, h, i); {
+            return a - b + c - d + e - g + h * i
+        };
+        {
+            call OutputNum(call f(1, 2, 3, 4, 5, 6, 7, 8));
+            call OutputNum(call f(1, 2, 3, 4, 5, 6, 7, 8) - 50)
+        }.
+    )";
+    EXPECT_EQ(run_native(*parse(s), "", "stack_args"), "533");
+}
+
+// the cases idiv traps on behave as in the vm
+TEST(X86, Division)
+{
+    std::string s = "main var x, y; { let x <- call InputNum; let y <- call InputNum; call OutputNum(x / y) }.";
+    EXPECT_EQ(run_native(*parse(s), "-7 2", "div"), "-3");
+    EXPECT_EQ(run_native(*parse(s), "7 -1", "div"), "-7");
+    EXPECT_EQ(run_native(*parse(s), "-9223372036854775808 -1", "div"), "-9223372036854775808");
+    EXPECT_EQ(run_native(*parse(s), "7 0", "div", 1), "");
+    std::string c = "main var x; { let x <- call InputNum; call OutputNum(x / (0 - 1)); call OutputNum(x / 0) }.";
+    EXPECT_EQ(run_native(*parse(c), "-9223372036854775808", "div_const", 1), "-9223372036854775808");
+}
+
+// a cmp shared by two branches is not fused, a - b would overflow
+TEST(X86, SharedCompare)
+{
+    std::string s = R"(
+        main
+        var a, b; {
+            let a <- call InputNum();
+            let b <- call InputNum();
+            if a < b then call OutputNum(1) fi;
+            if a < b then call OutputNum(2) fi
+        }.
+    )";
+    EXPECT_EQ(run_native(*parse(s, true), "9223372036854775807 -1", "shared_cmp"), "");
+    EXPECT_EQ(run_native(*parse(s, true), "-9223372036854775808 1", "shared_cmp"), "12");
+    EXPECT_EQ(run_native(*parse(s, true), "3 3", "shared_cmp"), "");
+}
+
+#endif